@@ -5,11 +5,16 @@ set(SRC_DIR "${PROJECT_SOURCE_DIR}/Source")
 set(CORE_SOURCE_FILES
    "${SRC_DIR}/Core/Archive.h"
    "${SRC_DIR}/Core/Assert.h"
+   "${SRC_DIR}/Core/BlipBuffer.h"
+   "${SRC_DIR}/Core/BlipBuffer.cpp"
    "${SRC_DIR}/Core/Enum.h"
    "${SRC_DIR}/Core/Log.h"
    "${SRC_DIR}/Core/Log.cpp"
    "${SRC_DIR}/Core/Math.h"
+   "${SRC_DIR}/Core/PerformanceCounters.h"
+   "${SRC_DIR}/Core/PerformanceCounters.cpp"
    "${SRC_DIR}/Core/RingBuffer.h"
+   "${SRC_DIR}/Core/TripleBuffer.h"
 )
 
 set(EMULATOR_SOURCE_FILES
@@ -24,14 +29,20 @@ set(GAMEBOY_SOURCE_FILES
    "${SRC_DIR}/GameBoy/Cartridge.cpp"
    "${SRC_DIR}/GameBoy/CPU.h"
    "${SRC_DIR}/GameBoy/CPU.cpp"
+   "${SRC_DIR}/GameBoy/FramebufferSink.h"
+   "${SRC_DIR}/GameBoy/FramebufferSink.cpp"
    "${SRC_DIR}/GameBoy/GameBoy.h"
    "${SRC_DIR}/GameBoy/GameBoy.cpp"
    "${SRC_DIR}/GameBoy/LCDController.h"
    "${SRC_DIR}/GameBoy/LCDController.cpp"
    "${SRC_DIR}/GameBoy/MemoryBankController.h"
    "${SRC_DIR}/GameBoy/MemoryBankController.cpp"
+   "${SRC_DIR}/GameBoy/ObservationSink.h"
+   "${SRC_DIR}/GameBoy/ObservationSink.cpp"
    "${SRC_DIR}/GameBoy/Operations.h"
    "${SRC_DIR}/GameBoy/Operations.cpp"
+   "${SRC_DIR}/GameBoy/ScanlineRenderer.h"
+   "${SRC_DIR}/GameBoy/ScanlineRenderer.cpp"
    "${SRC_DIR}/GameBoy/SoundController.h"
    "${SRC_DIR}/GameBoy/SoundController.cpp"
 )
@@ -41,6 +52,13 @@ set(PLATFORM_AUDIO_SOURCE_FILES
    "${SRC_DIR}/Platform/Audio/AudioManager.cpp"
 )
 
+set(PLATFORM_AUDIO_RECORDING_SOURCE_FILES
+   "${SRC_DIR}/Platform/Audio/AudioRecorder.h"
+   "${SRC_DIR}/Platform/Audio/AudioRecorder.cpp"
+   "${SRC_DIR}/Platform/Audio/WavWriter.h"
+   "${SRC_DIR}/Platform/Audio/WavWriter.cpp"
+)
+
 set(PLATFORM_INPUT_SOURCE_FILES
    "${SRC_DIR}/Platform/Input/InputDevice.h"
    "${SRC_DIR}/Platform/Input/ControllerInputDevice.h"
@@ -73,6 +91,8 @@ set(PLAYDATE_SOURCE_FILES
 )
 
 set(TEST_SOURCE_FILES
+   "${SRC_DIR}/Test/PNGWriter.h"
+   "${SRC_DIR}/Test/PNGWriter.cpp"
    "${SRC_DIR}/Test/TestMain.cpp"
 )
 
@@ -85,6 +105,7 @@ set(UI_SOURCE_FILES
    "${SRC_DIR}/UI/JoypadWindow.cpp"
    "${SRC_DIR}/UI/LCDControllerWindow.cpp"
    "${SRC_DIR}/UI/MemoryWindow.cpp"
+   "${SRC_DIR}/UI/PerformanceWindow.cpp"
    "${SRC_DIR}/UI/ScreenWindow.cpp"
    "${SRC_DIR}/UI/SoundControllerWindow.cpp"
    "${SRC_DIR}/UI/TimerWindow.cpp"
@@ -104,6 +125,7 @@ set(ALL_SOURCE_FILES
    ${EMULATOR_SOURCE_FILES}
    ${GAMEBOY_SOURCE_FILES}
    ${PLATFORM_AUDIO_SOURCE_FILES}
+   ${PLATFORM_AUDIO_RECORDING_SOURCE_FILES}
    ${PLATFORM_INPUT_SOURCE_FILES}
    ${PLATFORM_VIDEO_SOURCE_FILES}
    ${RETRO_SOURCE_FILES}
@@ -117,6 +139,7 @@ set(EMULATOR_PROJECT_SOURCE_FILES
    ${CORE_SOURCE_FILES}
    ${EMULATOR_SOURCE_FILES}
    ${GAMEBOY_SOURCE_FILES}
+   ${PLATFORM_AUDIO_RECORDING_SOURCE_FILES}
    ${PLATFORM_INPUT_SOURCE_FILES}
    ${PLATFORM_VIDEO_SOURCE_FILES}
 )
@@ -154,6 +177,7 @@ set(PLAYDATE_PROJECT_SOURCE_FILES
 set(TEST_PROJECT_SOURCE_FILES
    ${CORE_SOURCE_FILES}
    ${GAMEBOY_SOURCE_FILES}
+   ${PLATFORM_AUDIO_RECORDING_SOURCE_FILES}
    ${TEST_SOURCE_FILES}
 )
 
@@ -0,0 +1,139 @@
+#include "Core/Assert.h"
+#include "Core/BlipBuffer.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numbers>
+
+namespace DotMatrix
+{
+
+namespace
+{
+   const std::size_t kKernelHalfWidth = 8;
+   const std::size_t kKernelWidth = kKernelHalfWidth * 2;
+   const uint32_t kPhaseBits = 5;
+   const std::size_t kNumPhases = std::size_t{ 1 } << kPhaseBits;
+
+   // Each phase of the kernel sums to 1 << kDeltaBits, so a full step has been added once it is integrated
+   const uint32_t kDeltaBits = 15;
+   // Leak a little of the integrator every sample, which acts as a high-pass filter (removing any DC offset)
+   const uint32_t kBassShift = 9;
+
+   // Cutoff relative to the output's Nyquist frequency, which leaves room for the transition band of a short kernel
+   const double kCutoff = 0.9;
+
+   using Kernel = std::array<std::array<int16_t, kKernelWidth>, kNumPhases>;
+
+   // Blackman-windowed sinc, sampled for a step that happens a fraction of a sample (the phase) after the start of the kernel's center sample
+   Kernel createKernel()
+   {
+      Kernel kernel = {};
+
+      for (std::size_t phase = 0; phase < kNumPhases; ++phase)
+      {
+         double fraction = static_cast<double>(phase) / kNumPhases;
+
+         std::array<double, kKernelWidth> values = {};
+         double sum = 0.0;
+         for (std::size_t tap = 0; tap < kKernelWidth; ++tap)
+         {
+            double x = static_cast<double>(tap) - (kKernelHalfWidth - 1) - fraction;
+            double sinc = x == 0.0 ? 1.0 : std::sin(std::numbers::pi * kCutoff * x) / (std::numbers::pi * kCutoff * x);
+            double window = 0.42 + 0.5 * std::cos(std::numbers::pi * x / kKernelHalfWidth) + 0.08 * std::cos(2.0 * std::numbers::pi * x / kKernelHalfWidth);
+
+            values[tap] = sinc * window;
+            sum += values[tap];
+         }
+
+         int32_t total = 0;
+         for (std::size_t tap = 0; tap < kKernelWidth; ++tap)
+         {
+            kernel[phase][tap] = static_cast<int16_t>(std::lround(values[tap] / sum * (1 << kDeltaBits)));
+            total += kernel[phase][tap];
+         }
+
+         // Put any rounding error into the center tap, so a step always adds up to exactly one
+         kernel[phase][kKernelHalfWidth - 1] += static_cast<int16_t>((1 << kDeltaBits) - total);
+      }
+
+      return kernel;
+   }
+
+   const Kernel kKernel = createKernel();
+}
+
+BlipBuffer::BlipBuffer(std::size_t maxSamples)
+   : buffer(maxSamples + kKernelWidth)
+{
+}
+
+void BlipBuffer::setRates(double clockRate, double sampleRate)
+{
+   DM_ASSERT(clockRate > 0.0 && sampleRate > 0.0 && sampleRate <= clockRate);
+
+   factor = static_cast<uint64_t>(std::ceil(sampleRate / clockRate * static_cast<double>(uint64_t{ 1 } << kFractionBits)));
+}
+
+void BlipBuffer::addDelta(uint32_t time, int32_t delta)
+{
+   uint64_t position = offset + time * factor;
+   std::size_t index = static_cast<std::size_t>(position >> kFractionBits);
+   std::size_t phase = static_cast<std::size_t>(position >> (kFractionBits - kPhaseBits)) & (kNumPhases - 1);
+
+   DM_ASSERT(index + kKernelWidth <= buffer.size(), "Too many samples in a single frame");
+   if (index + kKernelWidth > buffer.size())
+   {
+      return;
+   }
+
+   const std::array<int16_t, kKernelWidth>& kernel = kKernel[phase];
+   int32_t* output = &buffer[index];
+   for (std::size_t tap = 0; tap < kKernelWidth; ++tap)
+   {
+      output[tap] += kernel[tap] * delta;
+   }
+}
+
+void BlipBuffer::endFrame(uint32_t time)
+{
+   offset += time * factor;
+
+   DM_ASSERT(getSamplesAvailable() + kKernelWidth <= buffer.size(), "Too many samples in a single frame");
+}
+
+std::size_t BlipBuffer::readSamples(std::span<int16_t> samples)
+{
+   std::size_t samplesAvailable = getSamplesAvailable();
+   std::size_t numSamples = std::min(samples.size(), samplesAvailable);
+
+   for (std::size_t i = 0; i < numSamples; ++i)
+   {
+      integrator += buffer[i];
+
+      int64_t sample = integrator >> kDeltaBits;
+      samples[i] = static_cast<int16_t>(std::clamp<int64_t>(sample, std::numeric_limits<int16_t>::min(), std::numeric_limits<int16_t>::max()));
+
+      integrator -= sample << (kDeltaBits - kBassShift);
+   }
+
+   // Shift the remaining samples (and the tail of the kernel beyond them) to the front
+   std::size_t numRemaining = samplesAvailable - numSamples + kKernelWidth;
+   std::copy(buffer.begin() + numSamples, buffer.begin() + numSamples + numRemaining, buffer.begin());
+   std::fill(buffer.begin() + numRemaining, buffer.begin() + numRemaining + numSamples, 0);
+
+   offset -= static_cast<uint64_t>(numSamples) << kFractionBits;
+
+   return numSamples;
+}
+
+void BlipBuffer::clear()
+{
+   std::fill(buffer.begin(), buffer.end(), 0);
+   offset &= (uint64_t{ 1 } << kFractionBits) - 1;
+   integrator = 0;
+}
+
+} // namespace DotMatrix
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace DotMatrix
+{
+
+// Band-limited synthesis from amplitude changes
+// Instead of point sampling a signal (which aliases badly for square waves), the producer reports each change in amplitude ("delta") along with the clock time it happened at
+// Each delta adds a band-limited step to the output, and the steps are integrated into samples in bulk once a frame of clocks is ended
+class BlipBuffer
+{
+public:
+   // maxSamples is the most samples a single frame can produce
+   BlipBuffer(std::size_t maxSamples);
+
+   // Sets the rate of the clock that times are given in, and the rate of the output samples
+   void setRates(double clockRate, double sampleRate);
+
+   // time is in clocks, relative to the start of the current frame
+   void addDelta(uint32_t time, int32_t delta);
+
+   // Makes the samples up to time available, and starts a new frame there
+   void endFrame(uint32_t time);
+
+   std::size_t getSamplesAvailable() const
+   {
+      return static_cast<std::size_t>(offset >> kFractionBits);
+   }
+
+   // Removes up to samples.size() samples, returning the number read
+   std::size_t readSamples(std::span<int16_t> samples);
+
+   void clear();
+
+private:
+   static constexpr uint32_t kFractionBits = 32;
+
+   std::vector<int32_t> buffer;
+   uint64_t factor = 0; // Samples per clock (fixed point)
+   uint64_t offset = 0; // Position of the start of the current frame, in samples (fixed point)
+   int64_t integrator = 0;
+};
+
+} // namespace DotMatrix
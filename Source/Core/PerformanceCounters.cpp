@@ -0,0 +1,112 @@
+#include "Core/Assert.h"
+#include "Core/PerformanceCounters.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace DotMatrix
+{
+
+namespace
+{
+   float percentile(const std::array<float, PerformanceHistory::kSize>& sortedSamples, std::size_t count, float fraction)
+   {
+      std::size_t index = static_cast<std::size_t>(std::ceil(fraction * count));
+      return sortedSamples[std::clamp<std::size_t>(index, 1, count) - 1];
+   }
+}
+
+const char* getPerformanceCounterName(PerformanceCounter counter)
+{
+   switch (counter)
+   {
+   case PerformanceCounter::EmulationTime:
+      return "Emulation time";
+   case PerformanceCounter::RenderTime:
+      return "Render time";
+   case PerformanceCounter::SwapTime:
+      return "Swap time";
+   case PerformanceCounter::AudioQueuedSamples:
+      return "Audio queued samples";
+   case PerformanceCounter::AudioBufferFill:
+      return "Audio buffer fill";
+   case PerformanceCounter::AudioRateAdjustment:
+      return "Audio rate adjustment";
+   case PerformanceCounter::AudioLatency:
+      return "Audio latency";
+   case PerformanceCounter::AudioWakeupJitter:
+      return "Audio wakeup jitter";
+   case PerformanceCounter::Drift:
+      return "Drift";
+   default:
+      return "Invalid";
+   }
+}
+
+PerformanceSummary summarize(const PerformanceHistory& history)
+{
+   PerformanceSummary summary;
+   if (history.count == 0)
+   {
+      return summary;
+   }
+
+   // Samples only need to be in order for the percentiles, so there's no need to unwrap them
+   std::array<float, PerformanceHistory::kSize> sortedSamples = history.samples;
+   std::sort(sortedSamples.begin(), sortedSamples.begin() + history.count);
+
+   float total = 0.0f;
+   for (std::size_t i = 0; i < history.count; ++i)
+   {
+      total += sortedSamples[i];
+   }
+
+   summary.mean = total / history.count;
+   summary.p50 = percentile(sortedSamples, history.count, 0.50f);
+   summary.p95 = percentile(sortedSamples, history.count, 0.95f);
+   summary.p99 = percentile(sortedSamples, history.count, 0.99f);
+   summary.max = sortedSamples[history.count - 1];
+
+   return summary;
+}
+
+void PerformanceCounters::record(PerformanceCounter counter, float value)
+{
+   DM_ASSERT(counter < PerformanceCounter::Count);
+
+   std::lock_guard<std::mutex> lock(mutex);
+
+   PerformanceHistory& history = histories[Enum::cast(counter)];
+   if (history.count < PerformanceHistory::kSize)
+   {
+      history.samples[history.count++] = value;
+   }
+   else
+   {
+      history.samples[history.offset] = value;
+      history.offset = (history.offset + 1) % PerformanceHistory::kSize;
+   }
+}
+
+void PerformanceCounters::reset()
+{
+   std::lock_guard<std::mutex> lock(mutex);
+
+   histories = {};
+}
+
+PerformanceHistory PerformanceCounters::getHistory(PerformanceCounter counter) const
+{
+   DM_ASSERT(counter < PerformanceCounter::Count);
+
+   std::lock_guard<std::mutex> lock(mutex);
+
+   return histories[Enum::cast(counter)];
+}
+
+PerformanceSummary PerformanceCounters::getSummary(PerformanceCounter counter) const
+{
+   return summarize(getHistory(counter));
+}
+
+} // namespace DotMatrix
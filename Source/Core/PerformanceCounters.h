@@ -0,0 +1,90 @@
+#pragma once
+
+#include "Core/Enum.h"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+namespace DotMatrix
+{
+
+enum class PerformanceCounter : uint8_t
+{
+   EmulationTime, // Milliseconds spent emulating a frame
+   RenderTime, // Milliseconds spent drawing a frame
+   SwapTime, // Milliseconds spent swapping buffers
+   AudioQueuedSamples, // Samples queued for playback that haven't been played yet
+   AudioBufferFill, // Milliseconds of audio still waiting to be queued for playback when a frame's audio is added
+   AudioRateAdjustment, // Percent that the audio sample rate is adjusted by to keep the buffer fill on target
+   AudioLatency, // Estimated milliseconds from a sample being produced to it being heard
+   AudioWakeupJitter, // Milliseconds the audio thread woke up after it was scheduled to (to queue a buffer the device has just finished with)
+   Drift, // Milliseconds the emulated clock is behind (positive) or ahead of (negative) the wall clock
+
+   Count
+};
+
+const char* getPerformanceCounterName(PerformanceCounter counter);
+
+// The most recent samples of a single counter, oldest first starting at offset (wrapping around)
+struct PerformanceHistory
+{
+   static constexpr std::size_t kSize = 240;
+
+   std::array<float, kSize> samples = {};
+   std::size_t offset = 0;
+   std::size_t count = 0;
+};
+
+struct PerformanceSummary
+{
+   float mean = 0.0f;
+   float p50 = 0.0f;
+   float p95 = 0.0f;
+   float p99 = 0.0f;
+   float max = 0.0f;
+};
+
+PerformanceSummary summarize(const PerformanceHistory& history);
+
+// Rolling history of each counter, which can be recorded from any thread
+class PerformanceCounters
+{
+public:
+   void record(PerformanceCounter counter, float value);
+   void reset();
+
+   PerformanceHistory getHistory(PerformanceCounter counter) const;
+   PerformanceSummary getSummary(PerformanceCounter counter) const;
+
+private:
+   mutable std::mutex mutex;
+   std::array<PerformanceHistory, Enum::cast(PerformanceCounter::Count)> histories;
+};
+
+// Records the time (in milliseconds) from construction to destruction
+class ScopedPerformanceTimer
+{
+public:
+   ScopedPerformanceTimer(PerformanceCounters& performanceCounters, PerformanceCounter performanceCounter)
+      : counters(performanceCounters)
+      , counter(performanceCounter)
+      , start(std::chrono::steady_clock::now())
+   {
+   }
+
+   ~ScopedPerformanceTimer()
+   {
+      std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+      counters.record(counter, elapsed.count());
+   }
+
+private:
+   PerformanceCounters& counters;
+   PerformanceCounter counter;
+   std::chrono::steady_clock::time_point start;
+};
+
+} // namespace DotMatrix
@@ -2,7 +2,9 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <span>
 
@@ -110,4 +112,123 @@ private:
    std::size_t readOffset = 0;
 };
 
+// Wait-free ring buffer shared between a single producer thread and a single consumer thread
+// Unlike RingBuffer, elements that haven't been consumed are never overwritten, instead new elements are dropped when the buffer is full
+template<typename T, std::size_t Size>
+class SPSCRingBuffer
+{
+public:
+   static_assert(Size > 0 && (Size & (Size - 1)) == 0, "Size must be a power of 2");
+
+   SPSCRingBuffer()
+      : buffer(std::make_unique<std::array<T, Size>>())
+   {
+   }
+
+   // Producer
+
+   bool push(T element)
+   {
+      return push(std::span<const T>(&element, 1)) == 1;
+   }
+
+   // Returns the number of elements pushed, the rest are dropped (and counted as overruns)
+   std::size_t push(std::span<const T> elements)
+   {
+      std::size_t localWriteIndex = writeIndex.load(std::memory_order_relaxed);
+
+      std::size_t numToPush = std::min(elements.size(), Size - (localWriteIndex - cachedReadIndex));
+      if (numToPush < elements.size())
+      {
+         // Only touch the consumer's cache line when the last known read index doesn't leave enough space
+         cachedReadIndex = readIndex.load(std::memory_order_acquire);
+         numToPush = std::min(elements.size(), Size - (localWriteIndex - cachedReadIndex));
+      }
+
+      std::size_t offset = localWriteIndex & kMask;
+      std::size_t firstPart = std::min(numToPush, Size - offset);
+      std::copy_n(elements.data(), firstPart, buffer->data() + offset);
+      std::copy_n(elements.data() + firstPart, numToPush - firstPart, buffer->data());
+
+      writeIndex.store(localWriteIndex + numToPush, std::memory_order_release);
+
+      if (numToPush < elements.size())
+      {
+         overruns.fetch_add(static_cast<uint32_t>(elements.size() - numToPush), std::memory_order_relaxed);
+      }
+
+      return numToPush;
+   }
+
+   // Consumer
+
+   // Returns the number of elements popped
+   std::size_t pop(std::span<T> elements)
+   {
+      std::size_t localReadIndex = readIndex.load(std::memory_order_relaxed);
+
+      std::size_t numToPop = std::min(elements.size(), cachedWriteIndex - localReadIndex);
+      if (numToPop < elements.size())
+      {
+         cachedWriteIndex = writeIndex.load(std::memory_order_acquire);
+         numToPop = std::min(elements.size(), cachedWriteIndex - localReadIndex);
+      }
+
+      if (numToPop == 0 && !elements.empty())
+      {
+         underruns.fetch_add(1, std::memory_order_relaxed);
+      }
+
+      std::size_t offset = localReadIndex & kMask;
+      std::size_t firstPart = std::min(numToPop, Size - offset);
+      std::copy_n(buffer->data() + offset, firstPart, elements.data());
+      std::copy_n(buffer->data(), numToPop - firstPart, elements.data() + firstPart);
+
+      readIndex.store(localReadIndex + numToPop, std::memory_order_release);
+
+      return numToPop;
+   }
+
+   // Any thread
+
+   // Exact on the consumer's thread, otherwise (e.g. on the producer's thread, for monitoring the fill level) it may lag behind slightly
+   std::size_t getNumAvailable() const
+   {
+      std::size_t localReadIndex = readIndex.load(std::memory_order_acquire);
+      return writeIndex.load(std::memory_order_acquire) - localReadIndex;
+   }
+
+   // Number of elements dropped because the buffer was full
+   uint32_t getNumOverruns() const
+   {
+      return overruns.load(std::memory_order_relaxed);
+   }
+
+   // Number of pops that found the buffer empty
+   uint32_t getNumUnderruns() const
+   {
+      return underruns.load(std::memory_order_relaxed);
+   }
+
+   constexpr std::size_t size() const
+   {
+      return Size;
+   }
+
+private:
+   static constexpr std::size_t kMask = Size - 1;
+
+   std::unique_ptr<std::array<T, Size>> buffer;
+
+   // The indices only ever increase (they are masked to get offsets), so a full buffer can be told apart from an empty one
+   // Each side keeps its own index, a cached copy of the other side's index, and its counter on a separate cache line
+   alignas(64) std::atomic<std::size_t> writeIndex = { 0 };
+   std::size_t cachedReadIndex = 0;
+   std::atomic<uint32_t> overruns = { 0 };
+
+   alignas(64) std::atomic<std::size_t> readIndex = { 0 };
+   std::size_t cachedWriteIndex = 0;
+   std::atomic<uint32_t> underruns = { 0 };
+};
+
 }
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace DotMatrix
+{
+
+// Lock-free handoff of whole values (e.g. frames) from a single producer to a single consumer
+// The producer always has a buffer to write into and never waits on the consumer, while the consumer always picks up the most recently published value
+template<typename T>
+class TripleBuffer
+{
+public:
+   TripleBuffer()
+      : buffers(std::make_unique<std::array<T, 3>>())
+   {
+   }
+
+   explicit TripleBuffer(const T& initialValue)
+      : TripleBuffer()
+   {
+      buffers->fill(initialValue);
+   }
+
+   // Producer
+
+   T& writeBuffer()
+   {
+      return (*buffers)[writeIndex];
+   }
+
+   void publish()
+   {
+      uint8_t previous = middle.exchange(writeIndex | kFreshBit, std::memory_order_acq_rel);
+      writeIndex = previous & kIndexMask;
+   }
+
+   // Consumer
+
+   // Returns false if nothing has been published since the last acquire (the read buffer is left as-is)
+   bool acquire()
+   {
+      if ((middle.load(std::memory_order_relaxed) & kFreshBit) == 0)
+      {
+         return false;
+      }
+
+      uint8_t previous = middle.exchange(readIndex, std::memory_order_acq_rel);
+      readIndex = previous & kIndexMask;
+
+      return true;
+   }
+
+   const T& readBuffer() const
+   {
+      return (*buffers)[readIndex];
+   }
+
+private:
+   static constexpr uint8_t kIndexMask = 0x03;
+   static constexpr uint8_t kFreshBit = 0x04;
+
+   std::unique_ptr<std::array<T, 3>> buffers;
+
+   // Kept on separate cache lines, since each side only touches its own index and the shared middle one
+   alignas(64) uint8_t writeIndex = 0;
+   alignas(64) std::atomic<uint8_t> middle = { 1 };
+   alignas(64) uint8_t readIndex = 2;
+};
+
+} // namespace DotMatrix
@@ -11,6 +11,7 @@
 #if DM_WITH_AUDIO
 #include "Platform/Audio/AudioManager.h"
 #endif // DM_WITH_AUDIO
+#include "Platform/Audio/AudioRecorder.h"
 #include "Platform/Video/Renderer.h"
 
 #if DM_WITH_UI
@@ -23,7 +24,10 @@
 #include <PlatformUtils/IOUtils.h>
 
 #include <algorithm>
+#include <chrono>
 #include <future>
+#include <iomanip>
+#include <sstream>
 #include <vector>
 
 namespace DotMatrix
@@ -38,10 +42,20 @@ const std::array<Pixel, 4> kFramebufferColors =
    Pixel(0x08, 0x29, 0x52)
 };
 
+const std::array<Pixel, 4> kGrayscaleFramebufferColors =
+{
+   Pixel(0xFF, 0xFF, 0xFF),
+   Pixel(0xAA, 0xAA, 0xAA),
+   Pixel(0x55, 0x55, 0x55),
+   Pixel(0x00, 0x00, 0x00)
+};
+
 namespace
 {
    #include "Logo.inl"
 
+   const double kClockCyclesPerFrame = 70224.0;
+
    const DotMatrix::Framebuffer& getLogoFramebuffer()
    {
       static DotMatrix::Framebuffer logoFramebuffer;
@@ -64,17 +78,6 @@ namespace
       return logoFramebuffer;
    }
 
-   void framebufferToPixels(const DotMatrix::Framebuffer& framebuffer, PixelArray& pixels)
-   {
-      DM_ASSERT(pixels.size() == framebuffer.size());
-
-      for (std::size_t i = 0; i < pixels.size(); ++i)
-      {
-         DM_ASSERT(framebuffer[i] < kFramebufferColors.size());
-         pixels[i] = kFramebufferColors[framebuffer[i]];
-      }
-   }
-
 #if DM_DEBUG
    const char* getGlErrorName(GLenum error)
    {
@@ -201,43 +204,87 @@ namespace
       return kBaseTitle;
    }
 
+   // Cartridge title as lower case letters, for naming files
+   std::string getFileNameBase(const char* title)
+   {
+      std::string fileName = title ? title : "";
+
+      // Remove all non-letters
+      fileName.erase(std::remove_if(fileName.begin(), fileName.end(), [](char c) { return !isalpha(c); }), fileName.end());
+
+      // Lower case
+      std::transform(fileName.begin(), fileName.end(), fileName.begin(), ::tolower);
+
+      return fileName;
+   }
+
    std::optional<std::filesystem::path> getSavePath(const char* title)
    {
       std::optional<std::filesystem::path> savePath;
 
-      if (title)
+      std::string fileName = getFileNameBase(title);
+      if (!fileName.empty())
       {
-         // Start with the cartridge title
-         std::string fileName = title;
-
-         // Remove all non-letters
-         fileName.erase(std::remove_if(fileName.begin(), fileName.end(), [](char c) { return !isalpha(c); }), fileName.end());
+         // Extension
+         fileName += ".sav";
 
-         // Lower case
-         std::transform(fileName.begin(), fileName.end(), fileName.begin(), ::tolower);
+         // Relative to the app data directory
+         savePath = IOUtils::getAbsoluteAppDataPath(DM_PROJECT_NAME, fileName);
+      }
 
-         if (!fileName.empty())
-         {
-            // Extension
-            fileName += ".sav";
+      return savePath;
+   }
 
-            // Relative to the app data directory
-            savePath = IOUtils::getAbsoluteAppDataPath(DM_PROJECT_NAME, fileName);
-         }
+   std::optional<std::filesystem::path> getRecordingPath(const char* title)
+   {
+      std::string fileName = getFileNameBase(title);
+      if (fileName.empty())
+      {
+         fileName = "recording";
       }
 
-      return savePath;
+      // Timestamped, so each recording gets its own file
+      tm time = Log::getCurrentTime();
+      std::stringstream ss;
+      ss << fileName << '_' << std::setfill('0')
+         << std::setw(4) << time.tm_year + 1900 << std::setw(2) << time.tm_mon + 1 << std::setw(2) << time.tm_mday << '_'
+         << std::setw(2) << time.tm_hour << std::setw(2) << time.tm_min << std::setw(2) << time.tm_sec << ".wav";
+
+      return IOUtils::getAbsoluteAppDataPath(DM_PROJECT_NAME, std::filesystem::path("Recordings") / ss.str());
    }
+
+#if DM_WITH_AUDIO
+   // The audio thread is woken up whenever there is audio to queue, this only bounds how long it takes to notice other changes (e.g. to the time scale)
+   const std::chrono::milliseconds kAudioIdleTimeout(100);
+
+   // Dynamic rate control: audio is produced slightly faster when the buffer is running low, and slightly slower when it is backing up
+   // This absorbs the audio device's clock drifting from the clock that emulation is timed with, without having to queue up extra audio
+   // A change in pitch of half a percent isn't noticeable
+   const double kMaxAudioRateAdjustment = 0.005;
+
+   // Samples that should still be waiting in the buffer when the next frame's audio is added (on top of what the audio device has queued)
+   // Two of the audio device's buffers, so there is always a whole buffer ready to queue
+   std::size_t calcTargetAudioBufferFill(const AudioManager::Config& config)
+   {
+      return config.bufferSize * 2;
+   }
+
+   double calcAudioRateScale(std::size_t bufferFill, std::size_t targetBufferFill)
+   {
+      double error = (static_cast<double>(targetBufferFill) - static_cast<double>(bufferFill)) / targetBufferFill;
+      return 1.0 + kMaxAudioRateAdjustment * std::clamp(error, -1.0, 1.0);
+   }
+#endif // DM_WITH_AUDIO
 }
 
 Emulator::Emulator()
-   : pixels(std::make_unique<PixelArray>(PixelArray{}))
 {
 }
 
 Emulator::~Emulator()
 {
    {
+      std::unique_lock<std::mutex> gameBoyLock = lockGameBoy();
       std::lock_guard<std::mutex> saveLock(saveThreadMutex);
 #if DM_WITH_AUDIO
       std::lock_guard<std::mutex> audioLock(audioThreadMutex);
@@ -245,6 +292,12 @@ Emulator::~Emulator()
       exiting.store(true);
    }
 
+   if (emulationThread.joinable())
+   {
+      emulationThreadConditionVariable.notify_all();
+      emulationThread.join();
+   }
+
    if (saveThread.joinable())
    {
       saveThreadConditionVariable.notify_all();
@@ -263,6 +316,9 @@ Emulator::~Emulator()
    ui = nullptr;
 #endif // DM_WITH_UI
 
+   // The emulation thread has already exited, so the recording can finish writing here
+   stopAudioRecording();
+
    renderer = nullptr;
    gameBoy = nullptr;
 
@@ -335,7 +391,10 @@ bool Emulator::init()
    }
 #endif // DM_WITH_BOOTSTRAP
 
-   resetGameBoy(nullptr);
+   {
+      std::unique_lock<std::mutex> lock = lockGameBoy();
+      resetGameBoy(nullptr);
+   }
 
    saveThread = std::thread([this]
    {
@@ -353,16 +412,27 @@ bool Emulator::init()
    ui = std::make_unique<UI>(window);
 #endif // DM_WITH_UI
 
+   emulationThread = std::thread([this]
+   {
+      emulationThreadMain();
+   });
+
    return true;
 }
 
-void Emulator::tick(double dt)
+void Emulator::pollInput()
+{
+   // Input devices can only be polled from the main thread, the emulation thread picks up the latest state each frame
+   joypadState.store(DotMatrix::Joypad::unionOf(keyboardInputDevice.poll(), controllerInputDevice.poll()));
+}
+
+double Emulator::emulateFrame(double dt)
 {
 #if DM_WITH_UI
    if (skipNextTick)
    {
       skipNextTick = false;
-      return;
+      return 0.0;
    }
 
    dt *= timeScale;
@@ -370,50 +440,134 @@ void Emulator::tick(double dt)
 
    if (gameBoy)
    {
-      DotMatrix::Joypad joypad = DotMatrix::Joypad::unionOf(keyboardInputDevice.poll(), controllerInputDevice.poll());
-      gameBoy->setJoypadState(joypad);
+      gameBoy->setJoypadState(joypadState.load());
 
       gameBoy->tick(dt);
 
+#if DM_WITH_AUDIO
+      SoundController& soundController = gameBoy->getSoundController();
+
+      uint32_t sampleRate = audioSampleRate.load();
+      if (soundController.getSampleRate() != sampleRate)
+      {
+         soundController.setSampleRate(sampleRate);
+      }
+
+      std::array<AudioSample, SoundController::kBufferSize> audioBuffer;
+      std::size_t numSamples = soundController.consumeAudio(audioBuffer);
+
+      // Audio is produced far faster than it can be played while fast forwarding, so drop it (muting it) instead of letting it back up
+      setProducingAudio(numSamples > 0 && !fastForward.load());
+      if (producingAudio)
+      {
+         std::size_t bufferFill = audioRingBuffer.getNumAvailable();
+         double rateScale = calcAudioRateScale(bufferFill, calcTargetAudioBufferFill(audioConfig.load()));
+         soundController.setSampleRateScale(rateScale);
+
+         std::size_t numAvailable = audioRingBuffer.push(std::span<const AudioSample>(audioBuffer.data(), numSamples)) + bufferFill;
+         if (numAvailable >= audioConfig.load().bufferSize)
+         {
+            // The ring buffer doesn't need the lock, but passing through it means the audio thread is either already waiting or hasn't checked the buffer yet, so the notification can't be lost
+            {
+               std::lock_guard<std::mutex> audioLock(audioThreadMutex);
+            }
+            audioThreadConditionVariable.notify_all();
+         }
+
+         performanceCounters.record(PerformanceCounter::AudioBufferFill, static_cast<float>(bufferFill * 1000.0 / sampleRate));
+         performanceCounters.record(PerformanceCounter::AudioRateAdjustment, static_cast<float>((rateScale - 1.0) * 100.0));
+      }
+#endif // DM_WITH_AUDIO
+
       bool cartWroteToRamThisFrame = gameBoy->cartWroteToRamThisFrame();
       if (!cartWroteToRamThisFrame && cartWroteToRamLastFrame)
       {
          saveGameAsync();
       }
       cartWroteToRamLastFrame = cartWroteToRamThisFrame;
+
+      return gameBoy->hasProgram() ? dt : 0.0;
    }
-   else
-   {
-      cartWroteToRamLastFrame = false;
-   }
+
+#if DM_WITH_AUDIO
+   setProducingAudio(false);
+#endif // DM_WITH_AUDIO
+
+   cartWroteToRamLastFrame = false;
+   return 0.0;
 }
 
 void Emulator::render()
 {
    if (renderer)
    {
-      if (gameBoy && gameBoy->hasProgram())
       {
-         framebufferToPixels(gameBoy->getLCDController().getFramebuffer(), *pixels);
+         ScopedPerformanceTimer renderTimer(performanceCounters, PerformanceCounter::RenderTime);
+         drawScreen();
       }
-      else
-      {
-         framebufferToPixels(getLogoFramebuffer(), *pixels);
-      }
-
-      renderer->draw(*pixels);
 
 #if DM_WITH_UI
       if (renderUi)
       {
+         // Keep the emulation thread from modifying the state being displayed (or edited)
+         std::unique_lock<std::mutex> lock = lockGameBoy();
          ui->render(*this);
       }
 #endif // DM_WITH_UI
    }
 
+   ScopedPerformanceTimer swapTimer(performanceCounters, PerformanceCounter::SwapTime);
    glfwSwapBuffers(window);
 }
 
+void Emulator::drawScreen()
+{
+   DM_ASSERT(renderer);
+
+   renderer->setPalette(useGrayscalePalette ? kGrayscaleFramebufferColors : kFramebufferColors);
+
+   // Only the shade indices are uploaded, the palette is applied by the renderer
+   DotMatrix::LineMask linesToUpdate;
+   if (gameBoy && gameBoy->hasProgram())
+   {
+      LCDController& lcdController = gameBoy->getLCDController();
+      if (lcdController.acquireLatestFrame())
+      {
+         // The per-frame diff is only enough when exactly one frame has completed since the last render
+         uint32_t frameCounter = lcdController.getFrameCounter();
+         if (frameCounter == lastRenderedFrameCounter + 1)
+         {
+            linesToUpdate = lcdController.getDirtyLines();
+         }
+         else
+         {
+            uploadAllLines = true;
+         }
+
+         lastRenderedFrameCounter = frameCounter;
+      }
+
+      if (uploadAllLines || rendererShowsLogo)
+      {
+         linesToUpdate.set();
+         uploadAllLines = false;
+         rendererShowsLogo = false;
+      }
+
+      renderer->draw(lcdController.getFramebuffer(), linesToUpdate);
+   }
+   else
+   {
+      if (!rendererShowsLogo)
+      {
+         linesToUpdate.set();
+         rendererShowsLogo = true;
+      }
+
+      renderer->draw(getLogoFramebuffer(), linesToUpdate);
+   }
+}
+
 bool Emulator::shouldExit() const
 {
    return glfwWindowShouldClose(window) != GLFW_FALSE;
@@ -433,17 +587,23 @@ void Emulator::setRom(const char* romPath)
 
          if (cartridge)
          {
-            resetGameBoy(std::move(cartridge));
+            std::unique_ptr<AudioRecorder> stoppedRecorder; // Finishes writing after the lock is released
+            {
+               std::unique_lock<std::mutex> lock = lockGameBoy();
 
-            std::string windowTitle = getWindowTitle(gameBoy.get());
-            glfwSetWindowTitle(window, windowTitle.c_str());
+               stoppedRecorder = stopAudioRecording();
+               resetGameBoy(std::move(cartridge));
 
-            // Try to load a save file
-            loadGame();
+               // Try to load a save file
+               loadGame();
 
 #if DM_WITH_UI
-            ui->onRomLoaded(*gameBoy, romPath);
+               ui->onRomLoaded(*gameBoy, romPath);
 #endif // DM_WITH_UI
+            }
+
+            std::string windowTitle = getWindowTitle(gameBoy.get());
+            glfwSetWindowTitle(window, windowTitle.c_str());
          }
          else
          {
@@ -479,6 +639,19 @@ void Emulator::onKeyChanged(int key, int scancode, int action, int mods)
       {
          toggleFullScreen();
       }
+      else if (key == GLFW_KEY_TAB)
+      {
+         fastForward.store(!fastForward.load());
+      }
+      else if (key == GLFW_KEY_F10)
+      {
+         // Shift also records each channel on its own
+         std::unique_ptr<AudioRecorder> stoppedRecorder;
+         {
+            std::unique_lock<std::mutex> lock = lockGameBoy();
+            stoppedRecorder = toggleAudioRecording((mods & GLFW_MOD_SHIFT) != 0);
+         }
+      }
 #if DM_WITH_UI
       else if (key == GLFW_KEY_SPACE)
       {
@@ -503,12 +676,12 @@ void Emulator::onWindowRefreshRequested()
 
 void Emulator::resetGameBoy(std::unique_ptr<DotMatrix::Cartridge> cartridge)
 {
-   {
-#if DM_WITH_AUDIO
-      std::unique_lock<std::mutex> lock(audioThreadMutex);
-#endif // DM_WITH_AUDIO
-      gameBoy = std::make_unique<DotMatrix::GameBoy>();
-   }
+   DM_ASSERT(!audioRecorder, "Audio recording needs to be stopped before resetting");
+
+   gameBoy = std::make_unique<DotMatrix::GameBoy>();
+   lastRenderedFrameCounter = 0;
+   uploadAllLines = true;
+   cartWroteToRamLastFrame = false;
 
 #if DM_WITH_BOOTSTRAP
    if (bootstrap.size() == 256)
@@ -519,12 +692,67 @@ void Emulator::resetGameBoy(std::unique_ptr<DotMatrix::Cartridge> cartridge)
 
    gameBoy->setCartridge(std::move(cartridge));
 
+   // Keep pixel work off the emulation thread when there are enough cores to go around (emulation, rendering, presentation and audio)
+   if (std::thread::hardware_concurrency() >= 4)
+   {
+      gameBoy->getLCDController().setParallelRenderingEnabled(true);
+   }
+
 #if DM_WITH_UI
    // Render once before ticking (to make sure we hit any initial breakpoints)
    skipNextTick = true;
 #endif // DM_WITH_UI
 }
 
+std::unique_ptr<AudioRecorder> Emulator::toggleAudioRecording(bool withStems)
+{
+   if (audioRecorder)
+   {
+      return stopAudioRecording();
+   }
+
+   if (!gameBoy)
+   {
+      return nullptr;
+   }
+
+   std::optional<std::filesystem::path> recordingPath = getRecordingPath(gameBoy->title());
+   if (!recordingPath)
+   {
+      return nullptr;
+   }
+
+   std::error_code errorCode;
+   std::filesystem::create_directories(recordingPath->parent_path(), errorCode);
+
+   // Always recorded at the default rate (instead of the audio device's), so recordings are comparable across machines
+   std::unique_ptr<AudioRecorder> recorder = std::make_unique<AudioRecorder>(*recordingPath, SoundController::kDefaultSampleRate, withStems);
+   if (recorder->isValid())
+   {
+      DM_LOG_INFO("Recording audio to " << recordingPath->string());
+
+      gameBoy->getSoundController().setAudioSink(recorder.get());
+      audioRecorder = std::move(recorder);
+   }
+
+   return nullptr;
+}
+
+std::unique_ptr<AudioRecorder> Emulator::stopAudioRecording()
+{
+   if (audioRecorder)
+   {
+      if (gameBoy)
+      {
+         gameBoy->getSoundController().setAudioSink(nullptr);
+      }
+
+      DM_LOG_INFO("Stopped recording audio to " << audioRecorder->getPath().string());
+   }
+
+   return std::move(audioRecorder);
+}
+
 void Emulator::toggleFullScreen()
 {
    DM_ASSERT(window);
@@ -563,30 +791,217 @@ void Emulator::toggleFullScreen()
    }
 }
 
+std::unique_lock<std::mutex> Emulator::lockGameBoy()
+{
+   gameBoyLockRequests.fetch_add(1);
+   std::unique_lock<std::mutex> lock(gameBoyMutex);
+   gameBoyLockRequests.fetch_sub(1);
+
+   // Let the emulation thread continue once this lock is released (it waits for lock requests while fast forwarding)
+   emulationThreadConditionVariable.notify_all();
+
+   return lock;
+}
+
+void Emulator::emulationThreadMain()
+{
+   using Clock = std::chrono::steady_clock;
+
+   // Emulate one frame at a time, at the Game Boy's own refresh rate (~59.73 Hz) rather than the host's
+   static const double kFrameTime = kClockCyclesPerFrame / CPU::kClockSpeed;
+   static const Clock::duration kFrameDuration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(kFrameTime));
+
+   // If we fall further behind than this (e.g. the process was suspended), skip ahead instead of trying to catch up
+   static const Clock::duration kMaxLag = std::chrono::milliseconds(50);
+
+   static const std::chrono::duration<double> kSpeedMeasurementInterval(0.5);
+
+   std::unique_lock<std::mutex> lock(gameBoyMutex);
+   Clock::time_point nextFrameTime = Clock::now();
+   Clock::time_point speedMeasurementStart = nextFrameTime;
+   double emulatedTime = 0.0;
+
+   while (!exiting.load())
+   {
+      Clock::time_point frameStart = Clock::now();
+      double frameTime = emulateFrame(kFrameTime);
+      emulatedTime += frameTime;
+
+      Clock::time_point now = Clock::now();
+      if (frameTime > 0.0)
+      {
+         performanceCounters.record(PerformanceCounter::EmulationTime, std::chrono::duration<float, std::milli>(now - frameStart).count());
+      }
+
+      std::chrono::duration<double> measuredTime = now - speedMeasurementStart;
+      if (measuredTime >= kSpeedMeasurementInterval)
+      {
+         emulationSpeed.store(emulatedTime / measuredTime.count());
+         emulatedTime = 0.0;
+         speedMeasurementStart = now;
+      }
+
+      if (fastForward.load() && frameTime > 0.0)
+      {
+         // Run as fast as the host allows, handing the lock over between frames whenever another thread is waiting for it
+         // (std::mutex isn't fair, so just unlocking and relocking would let this thread take it straight back)
+         // Presentation skips whatever frames complete between renders, since the renderer always picks up the latest one
+         nextFrameTime = now;
+
+         emulationThreadConditionVariable.wait(lock, [this]()
+         {
+            return exiting.load() || gameBoyLockRequests.load() == 0;
+         });
+
+         continue;
+      }
+
+      nextFrameTime += kFrameDuration;
+      if (frameTime > 0.0)
+      {
+         performanceCounters.record(PerformanceCounter::Drift, std::chrono::duration<float, std::milli>(now - nextFrameTime).count());
+      }
+
+      if (Clock::now() - nextFrameTime > kMaxLag)
+      {
+         nextFrameTime = Clock::now();
+      }
+
+      emulationThreadConditionVariable.wait_until(lock, nextFrameTime, [this]()
+      {
+         return exiting.load();
+      });
+   }
+}
+
 #if DM_WITH_AUDIO
+void Emulator::setProducingAudio(bool producing)
+{
+   if (producing != producingAudio)
+   {
+      producingAudio = producing;
+      audioProductionToggles.fetch_add(1);
+   }
+}
+
 void Emulator::audioThreadMain()
 {
-   AudioManager audioManager;
-   std::vector<AudioSample> audioBuffer(SoundController::kBufferSize);
+   std::unique_ptr<AudioManager> audioManager;
+   std::array<AudioSample, AudioManager::Config::kMaxBufferSize> audioBuffer;
+   AudioManager::Config config;
+   uint32_t previousUnderruns = 0; // From audio managers that have since been recreated
+   uint32_t lastProductionToggles = 0;
+   bool resuming = false;
 
-   std::unique_lock<std::mutex> lock(audioThreadMutex);
    while (!exiting.load())
    {
-      if (gameBoy && gameBoy->hasProgram() && audioManager.canQueue())
+      if (!audioManager || audioConfig.load() != config)
       {
-         std::size_t numSamples = gameBoy->getSoundController().consumeAudio(audioBuffer);
-         if (numSamples > 0)
+         if (audioManager)
          {
-            audioManager.queue(std::span<AudioSample>(audioBuffer.data(), numSamples));
+            previousUnderruns += audioManager->getNumUnderruns();
          }
+
+         config = audioConfig.load();
+
+         // The old device needs to be closed before the new one is opened
+         audioManager = nullptr;
+         audioManager = std::make_unique<AudioManager>(config);
+
+         audioSampleRate.store(audioManager->getSampleRate());
+
+         const AudioManager::Config& actualConfig = audioManager->getConfig();
+         DM_LOG_INFO("Audio output: " << actualConfig.numBuffers << " buffers of " << actualConfig.bufferSize << " samples at " << audioManager->getSampleRate() << " Hz");
       }
 
+      const uint32_t chunkSize = audioManager->getConfig().bufferSize;
+      std::span<AudioSample> chunk(audioBuffer.data(), chunkSize);
+
+      // Until audio is queued after production starts again, the source may have run dry on purpose
+      uint32_t productionToggles = audioProductionToggles.load();
+      if (productionToggles != lastProductionToggles)
+      {
+         lastProductionToggles = productionToggles;
+         resuming = true;
+      }
+      bool producing = (productionToggles % 2) == 1;
+
+      // Only whole chunks are queued, so whatever is left over stays in the ring buffer (where its fill level drives the rate control)
+      bool queued = false;
+      while (audioManager->canQueue() && audioRingBuffer.getNumAvailable() >= chunkSize)
+      {
+         std::size_t numSamples = audioRingBuffer.pop(chunk);
+         DM_ASSERT(numSamples == chunkSize);
+
+         audioManager->queue(chunk, resuming);
+         queued = true;
+      }
+
+      if (queued && producing)
+      {
+         resuming = false;
+      }
+
+      if (queued)
+      {
+         uint32_t numQueuedSamples = audioManager->getNumQueuedSamples();
+         std::size_t numWaitingSamples = numQueuedSamples + audioRingBuffer.getNumAvailable();
+         double latency = numWaitingSamples / static_cast<double>(audioManager->getSampleRate()) + audioManager->getDeviceLatency();
+
+         performanceCounters.record(PerformanceCounter::AudioQueuedSamples, static_cast<float>(numQueuedSamples));
+         performanceCounters.record(PerformanceCounter::AudioLatency, static_cast<float>(latency * 1000.0));
+      }
+
+      audioUnderruns.store(previousUnderruns + audioManager->getNumUnderruns());
+
 #if DM_WITH_UI
-      audioManager.setPitch(timeScale);
+      audioManager->setPitch(timeScale);
 #endif // DM_WITH_UI
 
-      audioThreadConditionVariable.wait_for(lock, std::chrono::milliseconds(4));
+      // Query the device before taking the lock, so the emulation thread is never held up by OpenAL
+      bool deviceValid = audioManager->isValid();
+      bool chunkReady = deviceValid && audioRingBuffer.getNumAvailable() >= chunkSize;
+      std::chrono::steady_clock::time_point wakeTime;
+      if (chunkReady)
+      {
+         std::chrono::duration<double> timeUntilCanQueue(audioManager->getTimeUntilCanQueue());
+         wakeTime = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeUntilCanQueue);
+      }
+
+      // The lock is only held while deciding whether to sleep, so a chunk added (and notified) in between isn't missed
+      std::unique_lock<std::mutex> lock(audioThreadMutex);
+      auto interrupted = [this, &config]()
+      {
+         return exiting.load() || audioConfig.load() != config;
+      };
+
+      if (!deviceValid)
+      {
+         // Without a device there's nothing to do until the config changes (which reopens it)
+         audioThreadConditionVariable.wait_for(lock, kAudioIdleTimeout, interrupted);
+      }
+      else if (chunkReady)
+      {
+         // A chunk is ready but every buffer is still queued, so sleep until the device will have played through the oldest one
+         if (!audioThreadConditionVariable.wait_until(lock, wakeTime, interrupted))
+         {
+            std::chrono::duration<float, std::milli> jitter = std::chrono::steady_clock::now() - wakeTime;
+            performanceCounters.record(PerformanceCounter::AudioWakeupJitter, jitter.count());
+         }
+      }
+      else
+      {
+         // Sleep until the emulation thread has produced another chunk
+         audioThreadConditionVariable.wait_for(lock, kAudioIdleTimeout, [this, chunkSize, &interrupted]()
+         {
+            return interrupted() || audioRingBuffer.getNumAvailable() >= chunkSize;
+         });
+      }
    }
+
+   PerformanceSummary latency = performanceCounters.getSummary(PerformanceCounter::AudioLatency);
+   PerformanceSummary jitter = performanceCounters.getSummary(PerformanceCounter::AudioWakeupJitter);
+   DM_LOG_INFO("Audio: " << audioUnderruns.load() << " underruns, latency p50 " << latency.p50 << " ms / p99 " << latency.p99 << " ms, wakeup jitter p99 " << jitter.p99 << " ms / max " << jitter.max << " ms");
 }
 #endif // DM_WITH_AUDIO
 
@@ -1,9 +1,16 @@
 #pragma once
 
 #include "Core/Archive.h"
+#include "Core/PerformanceCounters.h"
 
 #include "GameBoy/LCDController.h"
+#if DM_WITH_AUDIO
+#include "GameBoy/SoundController.h"
+#endif // DM_WITH_AUDIO
 
+#if DM_WITH_AUDIO
+#include "Platform/Audio/AudioManager.h"
+#endif // DM_WITH_AUDIO
 #include "Platform/Input/ControllerInputDevice.h"
 #include "Platform/Input/KeyboardInputDevice.h"
 
@@ -18,6 +25,7 @@
 #include <vector>
 #endif // DM_WITH_BOOTSTRAP
 
+class AudioRecorder;
 class Renderer;
 struct GLFWwindow;
 
@@ -45,9 +53,8 @@ struct Pixel
    }
 };
 
-using PixelArray = std::array<Pixel, DotMatrix::kScreenWidth* DotMatrix::kScreenHeight>;
-
 extern const std::array<Pixel, 4> kFramebufferColors;
+extern const std::array<Pixel, 4> kGrayscaleFramebufferColors;
 
 struct SaveData
 {
@@ -70,7 +77,7 @@ public:
    ~Emulator();
 
    bool init();
-   void tick(double dt);
+   void pollInput();
    void render();
    bool shouldExit() const;
 
@@ -81,15 +88,34 @@ public:
    void onKeyChanged(int key, int scancode, int action, int mods);
    void onWindowRefreshRequested();
 
+   const PerformanceCounters& getPerformanceCounters() const
+   {
+      return performanceCounters;
+   }
+
 private:
+   // Both require gameBoyMutex to be held
    void resetGameBoy(std::unique_ptr<DotMatrix::Cartridge> cartridge);
+   double emulateFrame(double dt);
+
+   void drawScreen();
    void toggleFullScreen();
 
+   // Both need gameBoyMutex to be held, and return the recorder that was stopped (if any)
+   // It should only be destroyed once the lock is released, since that waits for the rest of the recording to be written
+   std::unique_ptr<AudioRecorder> toggleAudioRecording(bool withStems);
+   std::unique_ptr<AudioRecorder> stopAudioRecording();
+
    void loadGame();
    void saveGameAsync();
    void saveThreadMain();
+   void emulationThreadMain();
+
+   // Locks gameBoyMutex from any thread other than the emulation thread, which hands it over between frames even while fast forwarding
+   std::unique_lock<std::mutex> lockGameBoy();
 
 #if DM_WITH_AUDIO
+   void setProducingAudio(bool producing);
    void audioThreadMain();
 #endif // DM_WITH_AUDIO
 
@@ -97,7 +123,10 @@ private:
    std::unique_ptr<DotMatrix::GameBoy> gameBoy;
    std::unique_ptr<Renderer> renderer;
 
-   std::unique_ptr<PixelArray> pixels;
+   uint32_t lastRenderedFrameCounter = 0;
+   bool rendererShowsLogo = false;
+   bool uploadAllLines = true;
+   bool useGrayscalePalette = false;
 
 #if DM_WITH_BOOTSTRAP
    std::vector<uint8_t> bootstrap;
@@ -105,7 +134,7 @@ private:
 
 #if DM_WITH_UI
    std::unique_ptr<UI> ui;
-   double timeScale = 1.0;
+   std::atomic<double> timeScale = { 1.0 };
    bool renderUi = true;
    bool skipNextTick = false;
 #endif // DM_WITH_UI
@@ -113,6 +142,10 @@ private:
    KeyboardInputDevice keyboardInputDevice;
    ControllerInputDevice controllerInputDevice;
 
+   std::atomic<Joypad> joypadState;
+   std::atomic_bool fastForward = { false };
+   std::atomic<double> emulationSpeed = { 0.0 }; // Emulated time per real time
+   PerformanceCounters performanceCounters;
    bool cartWroteToRamLastFrame = false;
    std::atomic<double> lastLoadTime = { 0.0 };
 
@@ -121,14 +154,32 @@ private:
 #if DM_WITH_AUDIO
    std::thread audioThread;
    std::mutex audioThreadMutex;
-   std::condition_variable audioThreadConditionVariable;
+   std::condition_variable audioThreadConditionVariable; // Notified by the emulation thread when a chunk of audio is ready
+
+   // Filled by the emulation thread after every frame, so the audio thread never needs to touch the game boy
+   SPSCRingBuffer<AudioSample, SoundController::kBufferSize> audioRingBuffer;
+   std::atomic<uint32_t> audioSampleRate = { SoundController::kDefaultSampleRate }; // Set by the audio thread to match the device
+   std::atomic<AudioManager::Config> audioConfig; // The audio thread recreates its audio manager when this changes
+   std::atomic<uint32_t> audioUnderruns = { 0 };
+   // Incremented by the emulation thread every time it deliberately stops or starts producing audio (so it's odd while producing)
+   // Lets the audio thread tell the source running dry on purpose apart from an underrun
+   std::atomic<uint32_t> audioProductionToggles = { 0 };
+   bool producingAudio = false; // Only accessed by the emulation thread
 #endif // DM_WITH_AUDIO
 
+   // The game boy is emulated on its own thread, which holds gameBoyMutex except while waiting for the next frame
+   std::thread emulationThread;
+   std::mutex gameBoyMutex;
+   std::atomic<uint32_t> gameBoyLockRequests = { 0 }; // Threads waiting in lockGameBoy()
+   std::condition_variable emulationThreadConditionVariable;
+
    std::thread saveThread;
    std::mutex saveThreadMutex;
    std::condition_variable saveThreadConditionVariable;
    moodycamel::ReaderWriterQueue<SaveData> saveQueue;
 
+   std::unique_ptr<AudioRecorder> audioRecorder; // Attached to the game boy's sound controller while recording
+
    Bounds savedWindowBounds;
 };
 
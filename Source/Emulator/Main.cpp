@@ -47,25 +47,12 @@ int main(int argc, char* argv[])
          emulator.setRom(argv[1]);
       }
 
-      static const double kMaxFrameTime = 0.05;
-      double lastTime = glfwGetTime();
-
+      // Emulation is paced on its own thread, this loop only handles events, input and presentation
       while (!emulator.shouldExit())
       {
-         double now = glfwGetTime();
-         double frameTime = now - lastTime;
-         lastTime = now;
-
-         // If the frame time is larger than the allowed max, we assume it was caused by an external event (e.g. the window was dragged)
-         // In this case, it's best to not tick any time to prevent audio from getting behind
-         if (frameTime > kMaxFrameTime)
-         {
-            frameTime = 0.0;
-         }
-
          glfwPollEvents();
 
-         emulator.tick(frameTime);
+         emulator.pollInput();
          emulator.render();
       }
    }
@@ -34,12 +34,28 @@ public:
       return GameBoy::kInvalidAddressByte;
    }
 
+   const uint8_t* dataPointer(size_t address, size_t size) const
+   {
+      if (address + size <= cartDataSize)
+      {
+         return &cartData[address];
+      }
+
+      return nullptr;
+   }
+
    uint8_t read(uint16_t address) const
    {
       DM_ASSERT(controller);
       return controller->read(address);
    }
 
+   const uint8_t* readPointer(uint16_t address, size_t size) const
+   {
+      DM_ASSERT(controller);
+      return controller->readPointer(address, size);
+   }
+
    void write(uint16_t address, uint8_t value)
    {
       DM_ASSERT(controller);
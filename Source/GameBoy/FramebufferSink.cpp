@@ -0,0 +1,148 @@
+#include "Core/Assert.h"
+
+#include "GameBoy/FramebufferSink.h"
+
+#include <cstring>
+
+namespace DotMatrix
+{
+
+namespace
+{
+   using ColorTable = std::array<uint32_t, 4>;
+
+   std::size_t bytesPerPixelForFormat(PixelFormat format)
+   {
+      switch (format)
+      {
+      case PixelFormat::RGB565:
+         return 2;
+      case PixelFormat::XRGB8888:
+         return 4;
+      case PixelFormat::RGB888:
+         return 3;
+      default:
+         DM_ASSERT(false);
+         return 4;
+      }
+   }
+
+   uint32_t encodeColor(PixelFormat format, uint32_t color)
+   {
+      uint32_t r = (color >> 16) & 0xFF;
+      uint32_t g = (color >> 8) & 0xFF;
+      uint32_t b = color & 0xFF;
+
+      switch (format)
+      {
+      case PixelFormat::RGB565:
+         return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+      case PixelFormat::XRGB8888:
+      case PixelFormat::RGB888: // Split into bytes when written
+         return (r << 16) | (g << 8) | b;
+      default:
+         DM_ASSERT(false);
+         return 0;
+      }
+   }
+
+   ColorTable createLut(PixelFormat format, const Palette& palette)
+   {
+      ColorTable lut;
+      for (std::size_t i = 0; i < lut.size(); ++i)
+      {
+         lut[i] = encodeColor(format, palette[i]);
+      }
+
+      return lut;
+   }
+
+   template<typename T>
+   void writePixels(uint8_t* destination, const uint8_t* shades, const ColorTable& lut)
+   {
+      for (std::size_t x = 0; x < kScreenWidth; ++x)
+      {
+         DM_ASSERT(shades[x] < lut.size());
+         T value = static_cast<T>(lut[shades[x] & 0x03]);
+         std::memcpy(destination + x * sizeof(T), &value, sizeof(T));
+      }
+   }
+
+   void convertLine(PixelFormat format, const ColorTable& lut, const uint8_t* shades, uint8_t* destination)
+   {
+      switch (format)
+      {
+      case PixelFormat::RGB565:
+         writePixels<uint16_t>(destination, shades, lut);
+         break;
+      case PixelFormat::XRGB8888:
+         writePixels<uint32_t>(destination, shades, lut);
+         break;
+      case PixelFormat::RGB888:
+         for (std::size_t x = 0; x < kScreenWidth; ++x)
+         {
+            DM_ASSERT(shades[x] < lut.size());
+            uint32_t value = lut[shades[x] & 0x03];
+            destination[x * 3 + 0] = static_cast<uint8_t>(value >> 16);
+            destination[x * 3 + 1] = static_cast<uint8_t>(value >> 8);
+            destination[x * 3 + 2] = static_cast<uint8_t>(value);
+         }
+         break;
+      default:
+         DM_ASSERT(false);
+         break;
+      }
+   }
+
+   std::vector<uint8_t> createBlankPixels(PixelFormat format, const ColorTable& lut)
+   {
+      std::size_t pitch = kScreenWidth * bytesPerPixelForFormat(format);
+      std::vector<uint8_t> pixels(pitch * kScreenHeight);
+
+      std::array<uint8_t, kScreenWidth> blankLine = {};
+      for (std::size_t line = 0; line < kScreenHeight; ++line)
+      {
+         convertLine(format, lut, blankLine.data(), pixels.data() + line * pitch);
+      }
+
+      return pixels;
+   }
+}
+
+PaletteFramebufferSink::PaletteFramebufferSink(PixelFormat pixelFormat, const Palette& palette)
+   : format(pixelFormat)
+   , bytesPerPixel(bytesPerPixelForFormat(pixelFormat))
+   , lut(createLut(pixelFormat, palette))
+   , frames(HostFrame{ createBlankPixels(pixelFormat, lut), {}, 0 })
+{
+}
+
+void PaletteFramebufferSink::writeLine(uint8_t line, const uint8_t* shades)
+{
+   DM_ASSERT(line < kScreenHeight);
+
+   convertLine(format, lut, shades, frames.writeBuffer().pixels.data() + line * getPitch());
+}
+
+void PaletteFramebufferSink::onFrameCompleted(const LineMask& dirtyLines)
+{
+   HostFrame& frame = frames.writeBuffer();
+   frame.dirtyLines = dirtyLines;
+   frame.sequence = ++frameCounter;
+
+   frames.publish();
+}
+
+void PaletteFramebufferSink::writeFrame(const Framebuffer& framebuffer)
+{
+   for (uint8_t line = 0; line < kScreenHeight; ++line)
+   {
+      writeLine(line, &framebuffer[line * kScreenWidth]);
+   }
+
+   LineMask allLines;
+   allLines.set();
+   onFrameCompleted(allLines);
+}
+
+} // namespace DotMatrix
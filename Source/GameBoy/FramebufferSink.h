@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Core/TripleBuffer.h"
+
+#include "GameBoy/LCDController.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace DotMatrix
+{
+
+// Receives each scanline as it is rendered, so frontends don't need their own full-frame conversion pass
+class FramebufferSink
+{
+public:
+   virtual ~FramebufferSink() = default;
+
+   // shades points to kScreenWidth 2-bit shade values
+   virtual void writeLine(uint8_t line, const uint8_t* shades) = 0;
+   // dirtyLines are the lines that changed since the previous completed frame
+   virtual void onFrameCompleted(const LineMask& dirtyLines) = 0;
+};
+
+enum class PixelFormat : uint8_t
+{
+   RGB565,
+   XRGB8888, // Native endian 32-bit words, 0x00RRGGBB
+   RGB888
+};
+
+// Colors for each shade, as 0xRRGGBB
+using Palette = std::array<uint32_t, 4>;
+
+// Converts shades to a host pixel format through a lookup table
+// Completed frames are handed off the same way as LCDController's 2-bit frames, so they can be presented from another thread
+class PaletteFramebufferSink final : public FramebufferSink
+{
+public:
+   PaletteFramebufferSink(PixelFormat pixelFormat, const Palette& palette);
+
+   void writeLine(uint8_t line, const uint8_t* shades) override;
+   void onFrameCompleted(const LineMask& dirtyLines) override;
+
+   // Converts an entire frame at once (e.g. for frames that don't come from an LCDController)
+   void writeFrame(const Framebuffer& framebuffer);
+
+   // Presentation side, returns false if no frame has been completed since the last call
+   bool acquireLatestFrame()
+   {
+      return frames.acquire();
+   }
+
+   PixelFormat getPixelFormat() const
+   {
+      return format;
+   }
+
+   std::size_t getBytesPerPixel() const
+   {
+      return bytesPerPixel;
+   }
+
+   std::size_t getPitch() const
+   {
+      return kScreenWidth * bytesPerPixel;
+   }
+
+   // Pixels of the acquired frame
+   const uint8_t* getPixels() const
+   {
+      return frames.readBuffer().pixels.data();
+   }
+
+   const LineMask& getDirtyLines() const
+   {
+      return frames.readBuffer().dirtyLines;
+   }
+
+   uint32_t getFrameCounter() const
+   {
+      return frames.readBuffer().sequence;
+   }
+
+private:
+   struct HostFrame
+   {
+      std::vector<uint8_t> pixels;
+      LineMask dirtyLines;
+      uint32_t sequence = 0;
+   };
+
+   PixelFormat format;
+   std::size_t bytesPerPixel;
+   std::array<uint32_t, 4> lut = {};
+
+   TripleBuffer<HostFrame> frames;
+   uint32_t frameCounter = 0;
+};
+
+} // namespace DotMatrix
@@ -56,6 +56,11 @@ GameBoy::GameBoy()
    , lastInputVals(P1::InMask)
 {
    updateP1();
+
+   // Sound synthesis is expensive on the PlayDate, so when audio is disabled only the state visible through the sound registers is kept up to date
+#if DM_PLATFORM_PLAYDATE && !DM_WITH_AUDIO
+   soundController.setAudioPolicy(AudioPolicy::Silent);
+#endif // DM_PLATFORM_PLAYDATE && !DM_WITH_AUDIO
 }
 
 // Need to define destructor in a location where the Cartridge class is defined, so a default deleter can be generated for it
@@ -125,11 +130,7 @@ void GameBoy::machineCycle()
 #endif // DM_PLATFORM_PLAYDATE
 
    lcdController.machineCycle();
-
-   // Sound emulation is expensive on the PlayDate, so we don't give the sound controller machine cycles when audio is disabled
-#if !DM_PLATFORM_PLAYDATE || DM_WITH_AUDIO
    soundController.machineCycle();
-#endif // !DM_PLATFORM_PLAYDATE || DM_WITH_AUDIO
 }
 
 #if DM_WITH_BOOTSTRAP
@@ -626,6 +627,9 @@ uint8_t GameBoy::readDirect(uint16_t address) const
 
 void GameBoy::writeDirect(uint16_t address, uint8_t value)
 {
+   // Any write could change memory that an in-progress OAM DMA transfer hasn't copied yet
+   lcdController.syncDMA();
+
    switch (address & 0xF000)
    {
    // Permanently-mapped ROM bank
@@ -698,4 +702,57 @@ void GameBoy::writeDirect(uint16_t address, uint8_t value)
    }
 }
 
+const uint8_t* GameBoy::readPointer(uint16_t address, std::size_t size) const
+{
+   // Ranges crossing into another region aren't handled
+   if (size == 0 || ((address & 0xF000) != ((address + size - 1) & 0xF000)))
+   {
+      return nullptr;
+   }
+
+   switch (address & 0xF000)
+   {
+   // Permanently-mapped ROM bank
+   case 0x0000:
+#if DM_WITH_BOOTSTRAP
+      if (address <= 0x00FF && booting && !bootstrap.empty())
+      {
+         return nullptr;
+      }
+#endif // DM_WITH_BOOTSTRAP
+   case 0x1000:
+   case 0x2000:
+   case 0x3000:
+   // Switchable ROM bank
+   case 0x4000:
+   case 0x5000:
+   case 0x6000:
+   case 0x7000:
+      return cart ? cart->readPointer(address, size) : nullptr;
+   // Video RAM
+   case 0x8000:
+   case 0x9000:
+      return lcdController.vramPointer(address);
+   // Working RAM bank 0
+   case 0xC000:
+      return &ram0[address - 0xC000];
+   // Working RAM bank 1
+   case 0xD000:
+      return &ram1[address - 0xD000];
+   // Mirror of working ram
+   case 0xE000:
+      return &ram0[address - 0xE000];
+   case 0xF000:
+      // Mirror of working ram (up to the sprite attribute table)
+      if (address + size <= 0xFE00)
+      {
+         return &ram1[address - 0xF000];
+      }
+      return nullptr;
+   // Switchable external RAM bank
+   default:
+      return nullptr;
+   }
+}
+
 } // namespace DotMatrix
@@ -202,6 +202,9 @@ public:
    uint8_t readDirect(uint16_t address) const;
    void writeDirect(uint16_t address, uint8_t value);
 
+   // Host memory backing size bytes starting at address, or nullptr if that range isn't plain memory (IO, cartridge RAM, etc.)
+   const uint8_t* readPointer(uint16_t address, std::size_t size) const;
+
 private:
    struct SerialControlRegister
    {
@@ -1,32 +1,17 @@
 #include "Core/Log.h"
-#include "Core/Math.h"
 
 #include "GameBoy/CPU.h"
 #include "GameBoy/LCDController.h"
 #include "GameBoy/GameBoy.h"
 
 #include <array>
+#include <cstring>
 
 namespace DotMatrix
 {
 
 namespace
 {
-   namespace LCDC
-   {
-      enum Enum : uint8_t
-      {
-         DisplayEnable = 1 << 7,
-         WindowTileMapDisplaySelect = 1 << 6,
-         WindowDisplayEnable = 1 << 5,
-         BGAndWindowTileDataSelect = 1 << 4,
-         BGTileMapDisplaySelect = 1 << 3,
-         ObjSpriteSize = 1 << 2,
-         ObjSpriteDisplayEnable = 1 << 1,
-         BGDisplay = 1 << 0
-      };
-   }
-
    namespace STAT
    {
       enum Enum : uint8_t
@@ -40,47 +25,12 @@ namespace
       };
    }
 
-   namespace Attrib
-   {
-      enum Enum : uint8_t
-      {
-         ObjToBgPriority = 1 << 7,
-         YFlip = 1 << 6,
-         XFlip = 1 << 5,
-         PaletteNumber = 1 << 4, // Non-CGB only
-         TileVRAMBank = 1 << 3, // CGB only
-         CGBPaletteNumber = (1 << 2) | (1 << 1) | (1 << 0) // CGB only
-      };
-   }
-
    const uint32_t kSearchOAMCycles = 80;
    const uint32_t kDataTransferCycles = 172;
    const uint32_t kHBlankCycles = 204;
    const uint32_t kCyclesPerLine = kSearchOAMCycles + kDataTransferCycles + kHBlankCycles; // 456
-}
 
-uint8_t LCDController::ControlRegister::read() const
-{
-   return lcdDisplayEnabled * LCDC::DisplayEnable
-      | windowUseUpperTileMap * LCDC::WindowTileMapDisplaySelect
-      | windowDisplayEnabled * LCDC::WindowDisplayEnable
-      | bgAndWindowUseUnsignedTileData * LCDC::BGAndWindowTileDataSelect
-      | bgUseUpperTileMap * LCDC::BGTileMapDisplaySelect
-      | useLargeSpriteSize * LCDC::ObjSpriteSize
-      | spriteDisplayEnabled * LCDC::ObjSpriteDisplayEnable
-      | bgWindowDisplayEnabled * LCDC::BGDisplay;
-}
-
-void LCDController::ControlRegister::write(uint8_t value)
-{
-   lcdDisplayEnabled = value & LCDC::DisplayEnable;
-   windowUseUpperTileMap = value & LCDC::WindowTileMapDisplaySelect;
-   windowDisplayEnabled = value & LCDC::WindowDisplayEnable;
-   bgAndWindowUseUnsignedTileData = value & LCDC::BGAndWindowTileDataSelect;
-   bgUseUpperTileMap = value & LCDC::BGTileMapDisplaySelect;
-   useLargeSpriteSize = value & LCDC::ObjSpriteSize;
-   spriteDisplayEnabled = value & LCDC::ObjSpriteDisplayEnable;
-   bgWindowDisplayEnabled = value & LCDC::BGDisplay;
+   const uint8_t kDMALength = 0xA0;
 }
 
 uint8_t LCDController::StatusRegister::read() const
@@ -110,10 +60,72 @@ LCDController::LCDController(GameBoy& gb)
 {
 }
 
+LCDController::~LCDController()
+{
+}
+
 void LCDController::onCPUStopped()
 {
    // When stopped, fill the screen with white
-   framebuffers.writeBuffer().fill(0x00);
+#if !DM_PROJECT_PLAYDATE
+   if (renderWorker)
+   {
+      renderWorker->logClearFrame();
+      return;
+   }
+#endif // !DM_PROJECT_PLAYDATE
+
+   renderer.clearFrame();
+}
+
+void LCDController::setFramebufferSink(FramebufferSink* sink)
+{
+#if !DM_PROJECT_PLAYDATE
+   if (renderWorker)
+   {
+      // The renderer is only touched by the worker while it has something to do
+      renderWorker->flush(*this);
+   }
+#endif // !DM_PROJECT_PLAYDATE
+
+   renderer.setFramebufferSink(sink);
+}
+
+void LCDController::setFramebufferFormat(FramebufferFormat format)
+{
+#if !DM_PROJECT_PLAYDATE
+   if (renderWorker)
+   {
+      renderWorker->flush(*this);
+   }
+#endif // !DM_PROJECT_PLAYDATE
+
+   renderer.setFramebufferFormat(format);
+}
+
+void LCDController::setParallelRenderingEnabled(bool enabled)
+{
+#if !DM_PROJECT_PLAYDATE
+   if (enabled && !renderWorker)
+   {
+      renderWorker = std::make_unique<ScanlineRenderWorker>(renderer, static_cast<const ScanState&>(*this));
+   }
+   else if (!enabled)
+   {
+      renderWorker = nullptr;
+   }
+#else
+   DM_ASSERT(!enabled, "Parallel rendering isn't supported on this platform");
+#endif // !DM_PROJECT_PLAYDATE
+}
+
+bool LCDController::isParallelRenderingEnabled() const
+{
+#if !DM_PROJECT_PLAYDATE
+   return renderWorker != nullptr;
+#else
+   return false;
+#endif // !DM_PROJECT_PLAYDATE
 }
 
 uint8_t LCDController::read(uint16_t address) const
@@ -195,6 +207,7 @@ void LCDController::write(uint16_t address, uint8_t value)
    if (address >= 0x8000 && address <= 0x9FFF)
    {
       vram[address - 0x8000] = value;
+      logWrite(address, value);
    }
    else if (address >= 0xFE00 && address <= 0xFEFF)
    {
@@ -202,15 +215,26 @@ void LCDController::write(uint16_t address, uint8_t value)
       if (isSpriteAttributeTableAccessible())
       {
          oam[address - 0xFE00] = value;
+         logWrite(address, value);
       }
    }
    else if (address >= 0xFF40 && address <= 0xFF4F)
    {
+      logWrite(address, value);
+
       switch (address)
       {
       case 0xFF40: // LCD control
+      {
+         bool wasDisplayEnabled = controlRegister.lcdDisplayEnabled;
          controlRegister.write(value);
+
+         if (controlRegister.lcdDisplayEnabled != wasDisplayEnabled)
+         {
+            onDisplayEnabledChanged();
+         }
          break;
+      }
       case 0xFF41: // LCD status
          statusRegister.write(value);
          break;
@@ -263,44 +287,46 @@ void LCDController::write(uint16_t address, uint8_t value)
    }
 }
 
-std::array<uint8_t, 4> LCDController::extractPaletteColors(uint8_t palette) const
-{
-   static const uint8_t kMask = 0x03;
-
-   std::array<uint8_t, 4> colors;
-   for (std::size_t i = 0; i < colors.size(); ++i)
-   {
-      std::size_t shift = i * 2;
-      colors[i] = (palette & (kMask << shift)) >> shift;
-   }
-
-   return colors;
-}
-
 void LCDController::updateDMA()
 {
    if (dmaPending)
    {
+      // Finish whatever a restarted transfer has already passed over
+      syncDMA();
+
       dmaPending = false;
 
       dmaInProgress = true;
       dmaIndex = 0x00;
+      dmaSyncedIndex = 0x00;
 
       DM_ASSERT(dma <= 0xF1);
       dmaSource = dma << 8;
+
+      // Plain memory can only change through writes (which sync first), so it can be copied lazily
+      // Anything else (IO, cartridge RAM / RTC) is read one byte per cycle, like the hardware does
+      dmaBulkCopy = gameBoy.readPointer(dmaSource, kDMALength) != nullptr;
    }
 
    if (dmaInProgress)
    {
-      if (dmaIndex <= 0x9F)
+      if (dmaIndex < kDMALength)
       {
-         oam[dmaIndex] = gameBoy.readDirect(dmaSource + dmaIndex);
+         if (!dmaBulkCopy)
+         {
+            oam[dmaIndex] = gameBoy.readDirect(dmaSource + dmaIndex);
+            logWrite(0xFE00 + dmaIndex, oam[dmaIndex]);
+            dmaSyncedIndex = dmaIndex + 1;
+         }
          ++dmaIndex;
       }
       else
       {
+         syncDMA();
+
          dmaInProgress = false;
          dmaIndex = 0x00;
+         dmaSyncedIndex = 0x00;
       }
    }
 
@@ -311,6 +337,32 @@ void LCDController::updateDMA()
    }
 }
 
+void LCDController::copyDMABytes()
+{
+   DM_ASSERT(dmaSyncedIndex < dmaIndex && dmaIndex <= kDMALength);
+
+   // Resolved every time, since the source may have been remapped (e.g. by a ROM bank switch) since the last sync
+   uint8_t count = dmaIndex - dmaSyncedIndex;
+   if (const uint8_t* source = gameBoy.readPointer(dmaSource + dmaSyncedIndex, count))
+   {
+      std::memcpy(&oam[dmaSyncedIndex], source, count);
+   }
+   else
+   {
+      for (uint8_t i = dmaSyncedIndex; i < dmaIndex; ++i)
+      {
+         oam[i] = gameBoy.readDirect(dmaSource + i);
+      }
+   }
+
+   for (uint8_t i = dmaSyncedIndex; i < dmaIndex; ++i)
+   {
+      logWrite(0xFE00 + i, oam[i]);
+   }
+
+   dmaSyncedIndex = dmaIndex;
+}
+
 void LCDController::updateMode()
 {
    DM_STATIC_ASSERT(kHBlankCycles % CPU::kClockCyclesPerMachineCycle == 0
@@ -330,6 +382,14 @@ void LCDController::updateMode()
       switch (lastMode)
       {
       case Mode::HBlank:
+         if (firstLineAfterEnable)
+         {
+            // The first line after the LCD is turned on skips OAM search, and stays in mode 0 until the data transfer starts
+            firstLineAfterEnable = false;
+            currentMode = Mode::DataTransfer;
+            break;
+         }
+
          ++ly;
 
          if (ly < 144)
@@ -415,8 +475,7 @@ void LCDController::setMode(Mode newMode)
          gameBoy.requestInterrupt(Interrupt::LCDState);
       }
 
-      framebuffers.flip();
-      bgPaletteIndices.fill(0);
+      publishFrame();
       break;
    case Mode::SearchOAM:
       if (statusRegister.oamInterrupt)
@@ -427,7 +486,7 @@ void LCDController::setMode(Mode newMode)
    case Mode::DataTransfer:
       DM_ASSERT(ly < 144);
 
-      scan(framebuffers.writeBuffer(), ly, extractPaletteColors(bgp));
+      scan();
       break;
    default:
       DM_ASSERT(false);
@@ -435,188 +494,71 @@ void LCDController::setMode(Mode newMode)
    }
 }
 
-void LCDController::scan(Framebuffer& framebuffer, uint8_t line, const std::array<uint8_t, 4>& paletteColors)
+void LCDController::scan()
 {
-   if (controlRegister.lcdDisplayEnabled)
-   {
-      if (controlRegister.bgWindowDisplayEnabled)
-      {
-         scanBackgroundOrWindow<false>(framebuffer, line, paletteColors);
-      }
-
-      if (controlRegister.bgWindowDisplayEnabled && controlRegister.windowDisplayEnabled)
-      {
-         scanBackgroundOrWindow<true>(framebuffer, line, paletteColors);
-      }
-
-      if (controlRegister.spriteDisplayEnabled)
-      {
-         scanSprites(framebuffer, line);
-      }
-   }
-   else
+   if (controlRegister.spriteDisplayEnabled)
    {
-      size_t lineOffset = line * kScreenWidth;
-      for (size_t x = 0; x < kScreenWidth; ++x)
-      {
-         framebuffer[lineOffset + x] = 0x00;
-      }
+      // Sprites see whatever part of OAM an in-progress DMA transfer has reached
+      syncDMA();
    }
-}
 
-template<bool isWindow>
-void LCDController::scanBackgroundOrWindow(Framebuffer& framebuffer, uint8_t line, const std::array<uint8_t, 4>& paletteColors)
-{
-   // 32x32 tiles, 8x8 pixels each
-   static const uint16_t kTileWidth = 8;
-   static const uint16_t kTileHeight = 8;
-   static const uint16_t kNumTilesPerLine = 32;
-   static const uint16_t kWindowXOffset = 7;
-
-   uint8_t y = line;
-   if (isWindow && y < wy)
+#if !DM_PROJECT_PLAYDATE
+   if (renderWorker)
    {
-      // Haven't reached the window yet
+      renderWorker->logScan(ly);
       return;
    }
+#endif // !DM_PROJECT_PLAYDATE
 
-   int16_t yOffset = isWindow ? -wy : scy;
-   int16_t xOffset = isWindow ? (kWindowXOffset - wx) : scx;
-
-   uint8_t adjustedY = y + yOffset;
-   uint8_t row = adjustedY % kTileHeight;
-   uint16_t tileMapYOffset = (adjustedY / kTileHeight) * kNumTilesPerLine;
-
-   bool tileMapDisplaySelect = isWindow ? controlRegister.windowUseUpperTileMap : controlRegister.bgUseUpperTileMap;
-   uint16_t tileMapBase = tileMapDisplaySelect ? 0x1C00 : 0x1800;
-   bool signedTileOffset = !controlRegister.bgAndWindowUseUnsignedTileData;
-
-   uint16_t pixelYOffset = kScreenWidth * y;
+   renderer.scan(*this, ly);
+}
 
-   uint8_t x = 0;
-   if (isWindow && xOffset < 0)
+void LCDController::publishFrame()
+{
+#if !DM_PROJECT_PLAYDATE
+   if (renderWorker)
    {
-      x -= xOffset;
+      renderWorker->logPublishFrame(*this);
+      return;
    }
+#endif // !DM_PROJECT_PLAYDATE
 
-   while (x < kScreenWidth)
-   {
-      uint8_t adjustedX = x + xOffset;
-      uint8_t tileMapXOffset = adjustedX / kTileWidth;
-      uint8_t col = adjustedX % kTileWidth;
-
-      uint16_t tileMapOffset = tileMapXOffset + tileMapYOffset;
-      uint8_t tileNum = vram[tileMapBase + tileMapOffset];
-      TileLine tileLine = fetchTileLine(tileNum, row, signedTileOffset);
-
-      for (; col < kTileWidth && x < kScreenWidth; ++col, ++x)
-      {
-         uint8_t mask = (0b10000000 >> col); // bit 7 is the leftmost pixel, bit 0 is the rightmost pixel
-         uint8_t paletteIndex = static_cast<bool>(tileLine.firstByte & mask) + 2 * static_cast<bool>(tileLine.secondByte & mask);
-
-         uint16_t pixel = x + pixelYOffset;
-         framebuffer[pixel] = paletteColors[paletteIndex];
-         if (!isWindow)
-         {
-            bgPaletteIndices[pixel] = paletteColors[paletteIndex];
-         }
-      }
-   }
+   renderer.publishFrame();
 }
 
-void LCDController::scanSprites(Framebuffer& framebuffer, uint8_t line)
+void LCDController::blankFrame()
 {
-   static const uint16_t kSpriteWidth = 8;
-   static const uint16_t kShortSpriteHeight = 8;
-   static const uint16_t kTallSpriteHeight = 16;
-   static const uint16_t kNumSprites = 40;
-
-   uint8_t y = line;
-   uint8_t spriteHeight = controlRegister.useLargeSpriteSize ? kTallSpriteHeight : kShortSpriteHeight;
-   uint16_t pixelYOffset = kScreenWidth * y;
-
-   for (int8_t sprite = kNumSprites - 1; sprite >= 0; --sprite)
+#if !DM_PROJECT_PLAYDATE
+   if (renderWorker)
    {
-      SpriteAttributes attributes = spriteAttributes[sprite];
-
-      int16_t spriteY = attributes.yPos - kTallSpriteHeight;
-      if (spriteY > y || spriteY + spriteHeight <= y
-         || attributes.xPos == 0 || attributes.xPos >= kScreenWidth + kSpriteWidth)
-      {
-         continue;
-      }
-
-      bool useObp1 = (attributes.flags & Attrib::PaletteNumber) != 0x00;
-      std::array<uint8_t, 4> paletteColors = extractPaletteColors(useObp1 ? obp1 : obp0);
-
-      uint8_t row = y - spriteY;
-      if (attributes.flags & Attrib::YFlip)
-      {
-         row = (kTallSpriteHeight - 1) - row;
-      }
-      row %= spriteHeight;
-
-      bool flipX = (attributes.flags & Attrib::XFlip) != 0x00;
-      TileLine tileLine = fetchTileLine(attributes.tileNum, row, false);
-
-      for (uint8_t col = 0; col < kSpriteWidth; ++col)
-      {
-         int16_t x = attributes.xPos - kSpriteWidth + col;
-         if (x < 0 || x > static_cast<int16_t>(kScreenWidth))
-         {
-            continue;
-         }
-
-         uint16_t pixel = x + pixelYOffset;
-
-         uint8_t mask = flipX ? (0b00000001 << col) : (0b10000000 >> col); // bit 7 is the leftmost pixel, bit 0 is the rightmost pixel
-         uint8_t paletteIndex = static_cast<bool>(tileLine.firstByte & mask) + 2 * static_cast<bool>(tileLine.secondByte & mask);
-
-         // Sprite palette index 0 is transparent
-         bool aboveBackground = paletteIndex != 0;
-
-         // If the OBJ-to-BG priority bit is set, the sprite is behind background palette colors 1-3
-         if (attributes.flags & Attrib::ObjToBgPriority)
-         {
-            DM_ASSERT(bgPaletteIndices[pixel] <= 3);
-            aboveBackground = aboveBackground && bgPaletteIndices[pixel] == 0;
-         }
-
-         if (aboveBackground)
-         {
-            framebuffer[pixel] = paletteColors[paletteIndex];
-         }
-      }
+      renderWorker->logBlankFrame(*this);
+      return;
    }
+#endif // !DM_PROJECT_PLAYDATE
+
+   renderer.blankFrame();
 }
 
-LCDController::TileLine LCDController::fetchTileLine(uint8_t tileNum, uint8_t line, bool signedTileOffset) const
+void LCDController::onDisplayEnabledChanged()
 {
-   static const uint8_t kBytesPerTile = 16;
-   static const uint8_t kBytesPerLine = 2;
-   static const uint16_t kSignedTileDataAddr = 0x0800;
-   static const uint16_t kUnsignedTileDataAddr = 0x0000;
-
-   uint16_t tileDataBase;
-   uint16_t tileDataTileOffset;
-   if (signedTileOffset)
+   ly = 0;
+   statusRegister.mode = Mode::HBlank;
+
+   if (controlRegister.lcdDisplayEnabled)
    {
-      tileDataBase = kSignedTileDataAddr;
-      tileDataTileOffset = (Math::reinterpretAsSigned(tileNum) + 128) * kBytesPerTile;
+      // Start over at the beginning of line 0, without requesting any mode interrupts
+      modeCyclesRemaining = kSearchOAMCycles;
+      firstLineAfterEnable = true;
+      updateLYC();
    }
    else
    {
-      tileDataBase = kUnsignedTileDataAddr;
-      tileDataTileOffset = tileNum * kBytesPerTile;
-   }
-   uint8_t tileDataLineOffset = line * kBytesPerLine;
-   uint16_t totalOffset = tileDataBase + tileDataTileOffset + tileDataLineOffset;
+      modeCyclesRemaining = kCyclesPerLine;
+      firstLineAfterEnable = false;
 
-   TileLine tileLine;
-   tileLine.firstByte = vram[totalOffset];
-   tileLine.secondByte = vram[totalOffset + 1];
-
-   return tileLine;
+      // The screen goes blank while the LCD is off, so produce one blank frame and then stop until it is turned back on
+      blankFrame();
+   }
 }
 
 } // namespace DotMatrix
@@ -1,89 +1,119 @@
 #pragma once
 
+#include "Core/Assert.h"
 #include "Core/Enum.h"
 
+#include "GameBoy/ScanlineRenderer.h"
+
 #include <array>
 #include <cstddef>
 #include <cstdint>
+#if !DM_PROJECT_PLAYDATE
 #include <memory>
+#endif // !DM_PROJECT_PLAYDATE
 
 namespace DotMatrix
 {
 
+class FramebufferSink;
 class GameBoy;
 
-constexpr size_t kScreenWidth = 160;
-constexpr size_t kScreenHeight = 144;
-
-using Framebuffer = std::array<uint8_t, kScreenWidth * kScreenHeight>;
-
-class DoubleBufferedFramebuffer
+// The registers and memory that scanning depends on are kept in ScanState, so they can be snapshotted for a render worker
+class LCDController : private ScanState
 {
 public:
-   DoubleBufferedFramebuffer()
+   LCDController(GameBoy& gb);
+   ~LCDController();
+
+   void machineCycle()
    {
-      for (std::size_t i = 0; i < buffers.size(); ++i)
+      updateDMA();
+
+      // While the LCD is off, LY and the mode are frozen, so there is nothing else to update
+      if (controlRegister.lcdDisplayEnabled)
       {
-         buffers[i] = std::make_unique<Framebuffer>();
-         buffers[i]->fill(0x00);
+         updateMode();
       }
    }
 
-   Framebuffer& writeBuffer() const
+   void onCPUStopped();
+
+   uint8_t read(uint16_t address) const;
+   void write(uint16_t address, uint8_t value);
+
+   const uint8_t* vramPointer(uint16_t address) const
    {
-      return *buffers[writeIndex];
+      DM_ASSERT(address >= 0x8000 && address <= 0x9FFF);
+      return &vram[address - 0x8000];
    }
 
-   const Framebuffer& readBuffer() const
+   // OAM DMA from plain memory is copied in bulk, so this needs to be called before anything it reads from might change
+   void syncDMA()
    {
-      return *buffers[!writeIndex];
+      if (dmaSyncedIndex < dmaIndex)
+      {
+         copyDMABytes();
+      }
    }
 
-   uint32_t getFrameCounter() const
+   // Presentation side, which may run on a different thread than emulation
+   // Picks up the most recently completed frame, returns false if there hasn't been a new one since the last call
+   bool acquireLatestFrame()
    {
-      return frameCounter;
+      return renderer.acquireLatestFrame();
    }
 
-   void flip()
+   // Only valid with FramebufferFormat::Unpacked (the default)
+   const Framebuffer& getFramebuffer() const
    {
-      writeIndex = !writeIndex;
-      ++frameCounter;
+      return renderer.getLatestFrame().pixels;
    }
 
-private:
-   std::array<std::unique_ptr<Framebuffer>, 2> buffers;
-   bool writeIndex = false;
-   uint32_t frameCounter = 0;
-};
+   // Only valid with FramebufferFormat::Packed
+   const PackedFramebuffer& getPackedFramebuffer() const
+   {
+      return renderer.getLatestPackedFrame().pixels;
+   }
 
-class LCDController
-{
-public:
-   LCDController(GameBoy& gb);
+   uint32_t getFrameCounter() const
+   {
+      return renderer.getLatestSequence();
+   }
 
-   void machineCycle()
+   // Lines of the acquired frame that differ from the frame before it
+   const LineMask& getDirtyLines() const
    {
-      updateDMA();
-      updateMode();
+      return renderer.getLatestDirtyLines();
    }
 
-   void onCPUStopped();
+   bool isFrameUnchanged() const
+   {
+      return getDirtyLines().none();
+   }
 
-   uint8_t read(uint16_t address) const;
-   void write(uint16_t address, uint8_t value);
+   // Optional, receives every rendered line in addition to the 2-bit framebuffer (not owned)
+   // When rendering in parallel, the sink is called from the render worker's thread
+   void setFramebufferSink(FramebufferSink* sink);
 
-   const Framebuffer& getFramebuffer() const
+   // Packed frames take a quarter of the memory, for headless instances that can read them as-is or unpack them on demand
+   // Not safe to call while frames are being acquired on another thread
+   void setFramebufferFormat(FramebufferFormat format);
+
+   FramebufferFormat getFramebufferFormat() const
    {
-      return framebuffers.readBuffer();
+      return renderer.getFramebufferFormat();
    }
 
-   uint32_t getFrameCounter() const
+   // Renders lines on a worker thread instead of while emulating, which produces the same frames
+   // State changed without going through write() (e.g. by a debugger) is only picked up at the start of the next frame
+   void setParallelRenderingEnabled(bool enabled);
+   bool isParallelRenderingEnabled() const;
+
+   std::array<uint8_t, 4> extractPaletteColors(uint8_t palette) const
    {
-      return framebuffers.getFrameCounter();
+      return DotMatrix::extractPaletteColors(palette);
    }
 
-   std::array<uint8_t, 4> extractPaletteColors(uint8_t palette) const;
-
 private:
    enum class Mode : uint8_t
    {
@@ -93,21 +123,6 @@ private:
       DataTransfer = 3
    };
 
-   struct ControlRegister
-   {
-      bool lcdDisplayEnabled = true;
-      bool windowUseUpperTileMap = false;
-      bool windowDisplayEnabled = false;
-      bool bgAndWindowUseUnsignedTileData = true;
-      bool bgUseUpperTileMap = false;
-      bool useLargeSpriteSize = false;
-      bool spriteDisplayEnabled = false;
-      bool bgWindowDisplayEnabled = true;
-
-      uint8_t read() const;
-      void write(uint8_t value);
-   };
-
    struct StatusRegister
    {
       bool coincidenceInterrupt = false;
@@ -121,31 +136,26 @@ private:
       void write(uint8_t value);
    };
 
-   struct SpriteAttributes
-   {
-      uint8_t yPos = 0;
-      uint8_t xPos = 0;
-      uint8_t tileNum = 0;
-      uint8_t flags = 0;
-   };
-
-   struct TileLine
-   {
-      uint8_t firstByte = 0x00;
-      uint8_t secondByte = 0x00;
-   };
-
    void updateDMA();
+   void copyDMABytes();
    void updateMode();
    void updateLYC();
    void setMode(Mode newMode);
+   void onDisplayEnabledChanged();
 
-   void scan(Framebuffer& framebuffer, uint8_t line, const std::array<uint8_t, 4>& paletteColors);
-   template<bool isWindow>
-   void scanBackgroundOrWindow(Framebuffer& framebuffer, uint8_t line, const std::array<uint8_t, 4>& paletteColors);
-   void scanSprites(Framebuffer& framebuffer, uint8_t line);
-
-   TileLine fetchTileLine(uint8_t tileNum, uint8_t line, bool signedTileOffset) const;
+   // Either render directly, or log for the render worker
+   void scan();
+   void publishFrame();
+   void blankFrame();
+   void logWrite(uint16_t address, uint8_t value)
+   {
+#if !DM_PROJECT_PLAYDATE
+      if (renderWorker)
+      {
+         renderWorker->logWrite(address, value);
+      }
+#endif // !DM_PROJECT_PLAYDATE
+   }
 
    bool isSpriteAttributeTableAccessible() const
    {
@@ -155,36 +165,26 @@ private:
    GameBoy& gameBoy;
 
    uint32_t modeCyclesRemaining = 0;
+   bool firstLineAfterEnable = false;
 
    bool dmaRequested = false;
    bool dmaPending = false;
    bool dmaInProgress = false;
    uint8_t dmaIndex = 0;
+   uint8_t dmaSyncedIndex = 0;
+   bool dmaBulkCopy = false;
    uint16_t dmaSource = 0;
 
-   ControlRegister controlRegister;
    StatusRegister statusRegister;
 
-   uint8_t scy = 0;
-   uint8_t scx = 0;
    uint8_t ly = 0;
    uint8_t lyc = 0;
    uint8_t dma = 0;
-   uint8_t bgp = 0xFC;
-   uint8_t obp0 = 0;
-   uint8_t obp1 = 0;
-   uint8_t wy = 0;
-   uint8_t wx = 0;
-
-   std::array<uint8_t, 0x2000> vram = {};
-   union
-   {
-      std::array<SpriteAttributes, 0x0040> spriteAttributes;
-      std::array<uint8_t, 0x0100> oam = {};
-   };
 
-   DoubleBufferedFramebuffer framebuffers;
-   std::array<uint8_t, kScreenWidth * kScreenHeight> bgPaletteIndices = {};
+   ScanlineRenderer renderer;
+#if !DM_PROJECT_PLAYDATE
+   std::unique_ptr<ScanlineRenderWorker> renderWorker; // Declared after the renderer, so it finishes before the renderer goes away
+#endif // !DM_PROJECT_PLAYDATE
 };
 
 } // namespace DotMatrix
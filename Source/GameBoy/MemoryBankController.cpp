@@ -19,6 +19,19 @@ namespace
 
       return static_cast<int64_t>(std::time(nullptr));
    }
+
+   // Only handles ranges that stay within one of the two ROM banks
+   const uint8_t* mappedROMPointer(const Cartridge& cart, uint16_t address, std::size_t size, int32_t switchableBankOffset)
+   {
+      std::size_t end = address + size;
+      if (size == 0 || end > 0x8000 || (address & 0x4000) != ((end - 1) & 0x4000))
+      {
+         return nullptr;
+      }
+
+      int32_t offset = address >= 0x4000 ? switchableBankOffset : 0;
+      return cart.dataPointer(address + offset, size);
+   }
 }
 
 // MBCNull
@@ -44,6 +57,11 @@ void MBCNull::write(uint16_t address, uint8_t value)
    DM_LOG_WARNING("Trying to write to read-only cartridge at location " << Log::hex(address) << ": " << Log::hex(value));
 }
 
+const uint8_t* MBCNull::readPointer(uint16_t address, std::size_t size) const
+{
+   return mappedROMPointer(cart, address, size, 0);
+}
+
 // MBC1
 
 MBC1::MBC1(const Cartridge& cartridge)
@@ -177,6 +195,11 @@ void MBC1::write(uint16_t address, uint8_t value)
    }
 }
 
+const uint8_t* MBC1::readPointer(uint16_t address, std::size_t size) const
+{
+   return mappedROMPointer(cart, address, size, (romBankNumber - 1) * 0x4000);
+}
+
 Archive MBC1::saveRAM() const
 {
    Archive ramData;
@@ -320,6 +343,11 @@ void MBC2::write(uint16_t address, uint8_t value)
    }
 }
 
+const uint8_t* MBC2::readPointer(uint16_t address, std::size_t size) const
+{
+   return mappedROMPointer(cart, address, size, (romBankNumber - 1) * 0x4000);
+}
+
 Archive MBC2::saveRAM() const
 {
    Archive ramData;
@@ -553,6 +581,11 @@ void MBC3::tick(double dt)
    rtc.daysCarry = daysMsb > 1; // Carry bit set on overflow, stays until the program resets it
 }
 
+const uint8_t* MBC3::readPointer(uint16_t address, std::size_t size) const
+{
+   return mappedROMPointer(cart, address, size, (romBankNumber - 1) * 0x4000);
+}
+
 Archive MBC3::saveRAM() const
 {
    Archive ramData;
@@ -710,6 +743,11 @@ void MBC5::write(uint16_t address, uint8_t value)
    }
 }
 
+const uint8_t* MBC5::readPointer(uint16_t address, std::size_t size) const
+{
+   return mappedROMPointer(cart, address, size, (static_cast<int16_t>(romBankNumber) - 1) * 0x4000);
+}
+
 Archive MBC5::saveRAM() const
 {
    Archive ramData;
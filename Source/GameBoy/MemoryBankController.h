@@ -3,6 +3,7 @@
 #include "Core/Archive.h"
 
 #include <array>
+#include <cstddef>
 #include <cstdint>
 
 namespace DotMatrix
@@ -25,6 +26,12 @@ public:
    virtual uint8_t read(uint16_t address) const = 0;
    virtual void write(uint16_t address, uint8_t value) = 0;
 
+   // Host memory backing size bytes starting at address, or nullptr if they can't be read directly (e.g. cartridge RAM)
+   virtual const uint8_t* readPointer(uint16_t address, std::size_t size) const
+   {
+      return nullptr;
+   }
+
    virtual void tick(double dt)
    {
       wroteToRam = false;
@@ -57,6 +64,7 @@ public:
 
    uint8_t read(uint16_t address) const override;
    void write(uint16_t address, uint8_t value) override;
+   const uint8_t* readPointer(uint16_t address, std::size_t size) const override;
 };
 
 class MBC1 final : public MemoryBankController
@@ -66,6 +74,7 @@ public:
 
    uint8_t read(uint16_t address) const override;
    void write(uint16_t address, uint8_t value) override;
+   const uint8_t* readPointer(uint16_t address, std::size_t size) const override;
 
    Archive saveRAM() const override;
    bool loadRAM(Archive& ramData) override;
@@ -92,6 +101,7 @@ public:
 
    uint8_t read(uint16_t address) const override;
    void write(uint16_t address, uint8_t value) override;
+   const uint8_t* readPointer(uint16_t address, std::size_t size) const override;
 
    Archive saveRAM() const override;
    bool loadRAM(Archive& ramData) override;
@@ -110,6 +120,7 @@ public:
 
    uint8_t read(uint16_t address) const override;
    void write(uint16_t address, uint8_t value) override;
+   const uint8_t* readPointer(uint16_t address, std::size_t size) const override;
 
    void tick(double dt) override;
 
@@ -169,6 +180,7 @@ public:
 
    uint8_t read(uint16_t address) const override;
    void write(uint16_t address, uint8_t value) override;
+   const uint8_t* readPointer(uint16_t address, std::size_t size) const override;
 
    Archive saveRAM() const override;
    bool loadRAM(Archive& ramData) override;
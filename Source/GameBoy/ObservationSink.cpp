@@ -0,0 +1,212 @@
+#include "Core/Assert.h"
+
+#include "GameBoy/ObservationSink.h"
+
+#include <array>
+#include <cstring>
+#include <type_traits>
+
+namespace DotMatrix
+{
+
+namespace
+{
+   constexpr uint32_t kMaxShade = 3;
+
+   std::size_t bytesPerValueForFormat(ObservationFormat format)
+   {
+      switch (format)
+      {
+      case ObservationFormat::UInt8:
+         return sizeof(uint8_t);
+      case ObservationFormat::Float32:
+         return sizeof(float);
+      default:
+         DM_ASSERT(false);
+         return sizeof(uint8_t);
+      }
+   }
+
+   // Maps the sum of the shades in a block (0 is white, 3 is black) to its average brightness
+   template<typename T, uint32_t maxSum>
+   std::array<T, maxSum + 1> createBrightnessTable()
+   {
+      std::array<T, maxSum + 1> table;
+      for (uint32_t sum = 0; sum <= maxSum; ++sum)
+      {
+         if constexpr (std::is_floating_point_v<T>)
+         {
+            table[sum] = static_cast<T>(maxSum - sum) / maxSum;
+         }
+         else
+         {
+            table[sum] = static_cast<T>(((maxSum - sum) * 255 + maxSum / 2) / maxSum);
+         }
+      }
+
+      return table;
+   }
+
+   // The block size is a template parameter so the inner loops have fixed trip counts and can be unrolled / vectorized
+   template<std::size_t factor, typename T>
+   void averageBlocks(const uint8_t* blockShades, std::size_t lineWidth, T* output, std::size_t outputWidth)
+   {
+      static constexpr uint32_t kMaxSum = kMaxShade * factor * factor;
+      static const std::array<T, kMaxSum + 1> kBrightness = createBrightnessTable<T, kMaxSum>();
+
+      for (std::size_t x = 0; x < outputWidth; ++x)
+      {
+         uint32_t sum = 0;
+         for (std::size_t row = 0; row < factor; ++row)
+         {
+            const uint8_t* shades = blockShades + row * lineWidth + x * factor;
+            for (std::size_t col = 0; col < factor; ++col)
+            {
+               sum += shades[col];
+            }
+         }
+
+         DM_ASSERT(sum <= kMaxSum);
+         output[x] = kBrightness[sum];
+      }
+   }
+
+   template<typename T>
+   void downsample(std::size_t factor, const uint8_t* blockShades, std::size_t lineWidth, T* output, std::size_t outputWidth)
+   {
+      switch (factor)
+      {
+      case 1:
+         averageBlocks<1>(blockShades, lineWidth, output, outputWidth);
+         break;
+      case 2:
+         averageBlocks<2>(blockShades, lineWidth, output, outputWidth);
+         break;
+      case 4:
+         averageBlocks<4>(blockShades, lineWidth, output, outputWidth);
+         break;
+      default:
+         DM_ASSERT(false, "Unsupported downsample factor: %zu", factor);
+         break;
+      }
+   }
+}
+
+bool ObservationConfig::isValid() const
+{
+   bool validFactor = downsampleFactor == 1 || downsampleFactor == 2 || downsampleFactor == 4;
+   bool validCrop = cropWidth > 0 && cropHeight > 0 && cropX + cropWidth <= kScreenWidth && cropY + cropHeight <= kScreenHeight;
+
+   return validFactor && validCrop && cropWidth % downsampleFactor == 0 && cropHeight % downsampleFactor == 0 && numStackedFrames > 0;
+}
+
+// static
+std::unique_ptr<ObservationSink> ObservationSink::create(const ObservationConfig& observationConfig, std::string& error)
+{
+   if (!observationConfig.isValid())
+   {
+      error = "Observation config is invalid (the downsample factor must be 1, 2 or 4 and divide the crop size, the crop must be on screen, and at least one frame must be stacked)";
+      return nullptr;
+   }
+
+   return std::unique_ptr<ObservationSink>(new ObservationSink(observationConfig));
+}
+
+ObservationSink::ObservationSink(const ObservationConfig& observationConfig)
+   : config(observationConfig)
+{
+   DM_ASSERT(config.isValid());
+
+   newestFrameIndex = config.layout == ObservationLayout::Shifted ? config.numStackedFrames - 1u : 0;
+
+   width = config.cropWidth / config.downsampleFactor;
+   height = config.cropHeight / config.downsampleFactor;
+
+   blockShades.resize(config.cropWidth * config.downsampleFactor);
+   frameInProgress.resize(width * height * bytesPerValueForFormat(config.format));
+}
+
+void ObservationSink::writeLine(uint8_t line, const uint8_t* shades)
+{
+   DM_ASSERT(line < kScreenHeight);
+
+   if (line < config.cropY || line >= config.cropY + config.cropHeight)
+   {
+      return;
+   }
+
+   std::size_t lineInCrop = line - config.cropY;
+   std::size_t rowInBlock = lineInCrop % config.downsampleFactor;
+   std::memcpy(&blockShades[rowInBlock * config.cropWidth], shades + config.cropX, config.cropWidth);
+
+   // Lines arrive in order, so a block is complete once its last line has been received
+   if (rowInBlock == config.downsampleFactor - 1u)
+   {
+      downsampleBlock(lineInCrop / config.downsampleFactor);
+   }
+}
+
+void ObservationSink::onFrameCompleted(const LineMask&)
+{
+   ++numFramesObserved;
+
+   if (!observationBuffer)
+   {
+      return;
+   }
+
+   uint8_t* buffer = static_cast<uint8_t*>(observationBuffer);
+   std::size_t frameSize = getFrameSize();
+
+   switch (config.layout)
+   {
+   case ObservationLayout::Shifted:
+   {
+      // Drop the oldest frame and append the new one
+      std::size_t numOlderFrames = config.numStackedFrames - 1u;
+      std::memmove(buffer, buffer + frameSize, frameSize * numOlderFrames);
+      break;
+   }
+   case ObservationLayout::Ring:
+      newestFrameIndex = (newestFrameIndex + 1) % config.numStackedFrames;
+      break;
+   default:
+      DM_ASSERT(false);
+      break;
+   }
+
+   std::memcpy(buffer + frameSize * newestFrameIndex, frameInProgress.data(), frameSize);
+}
+
+void ObservationSink::setBuffer(void* buffer)
+{
+   DM_ASSERT(reinterpret_cast<uintptr_t>(buffer) % bytesPerValueForFormat(config.format) == 0);
+
+   observationBuffer = buffer;
+   if (observationBuffer)
+   {
+      std::memset(observationBuffer, 0, getObservationSize());
+   }
+}
+
+void ObservationSink::downsampleBlock(std::size_t blockRow)
+{
+   DM_ASSERT(blockRow < height);
+
+   uint8_t* output = frameInProgress.data() + blockRow * width * bytesPerValueForFormat(config.format);
+
+   switch (config.format)
+   {
+   case ObservationFormat::UInt8:
+      downsample(config.downsampleFactor, blockShades.data(), config.cropWidth, output, width);
+      break;
+   case ObservationFormat::Float32:
+      downsample(config.downsampleFactor, blockShades.data(), config.cropWidth, reinterpret_cast<float*>(output), width);
+      break;
+   default:
+      DM_ASSERT(false);
+      break;
+   }
+}
+
+} // namespace DotMatrix
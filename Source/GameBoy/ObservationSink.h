@@ -0,0 +1,114 @@
+#pragma once
+
+#include "GameBoy/FramebufferSink.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace DotMatrix
+{
+
+enum class ObservationFormat : uint8_t
+{
+   UInt8, // 0 (black) to 255 (white)
+   Float32 // 0.0 (black) to 1.0 (white)
+};
+
+enum class ObservationLayout : uint8_t
+{
+   Shifted, // Oldest frame first, so every completed frame moves the older ones down (copying numStackedFrames - 1 frames)
+   Ring // Each completed frame overwrites the oldest one in place, getNewestFrameIndex() says where the newest one is
+};
+
+struct ObservationConfig
+{
+   // Region of the screen to observe, its size must be a multiple of the downsample factor
+   uint8_t cropX = 0;
+   uint8_t cropY = 0;
+   uint8_t cropWidth = kScreenWidth;
+   uint8_t cropHeight = kScreenHeight;
+
+   uint8_t downsampleFactor = 1; // 1, 2 or 4, each observed pixel is the average of a factor x factor area of the screen
+   // Each observation holds this many of the most recent frames
+   // With the shifted layout, stacking costs an extra pass over the older frames every frame, which the ring layout avoids
+   uint8_t numStackedFrames = 1;
+   ObservationLayout layout = ObservationLayout::Shifted;
+   ObservationFormat format = ObservationFormat::UInt8;
+
+   bool isValid() const;
+};
+
+// Builds grayscale observations (e.g. for training agents) from lines as they are rendered, so the full framebuffer never needs to be read back
+// Observations are written into a caller-provided buffer laid out as [frame][y][x] (see ObservationLayout for the frame order), which is only updated when a frame completes
+// When rendering in parallel, lines are received on the render worker's thread, so the buffer must not be read while emulating
+class ObservationSink final : public FramebufferSink
+{
+public:
+   // Returns null (and sets error) if the config is invalid
+   static std::unique_ptr<ObservationSink> create(const ObservationConfig& observationConfig, std::string& error);
+
+   void writeLine(uint8_t line, const uint8_t* shades) override;
+   void onFrameCompleted(const LineMask&) override;
+
+   // buffer (not owned) must hold getObservationSize() bytes, aligned for the format, and is cleared when set
+   void setBuffer(void* buffer);
+
+   const ObservationConfig& getConfig() const
+   {
+      return config;
+   }
+
+   std::size_t getWidth() const
+   {
+      return width;
+   }
+
+   std::size_t getHeight() const
+   {
+      return height;
+   }
+
+   // Size of a single frame of the observation, in bytes
+   std::size_t getFrameSize() const
+   {
+      return frameInProgress.size();
+   }
+
+   // Size of the whole observation (all stacked frames), in bytes
+   std::size_t getObservationSize() const
+   {
+      return getFrameSize() * config.numStackedFrames;
+   }
+
+   uint32_t getNumFramesObserved() const
+   {
+      return numFramesObserved;
+   }
+
+   // Index of the most recent frame in the observation buffer (always the last one with the shifted layout)
+   // With the ring layout, older frames precede it, wrapping around
+   std::size_t getNewestFrameIndex() const
+   {
+      return newestFrameIndex;
+   }
+
+private:
+   explicit ObservationSink(const ObservationConfig& observationConfig);
+
+   void downsampleBlock(std::size_t blockRow);
+
+   ObservationConfig config;
+   std::size_t width = 0;
+   std::size_t height = 0;
+
+   std::vector<uint8_t> blockShades; // The cropped lines of the block (downsampleFactor lines) being received
+   std::vector<uint8_t> frameInProgress;
+   void* observationBuffer = nullptr;
+   std::size_t newestFrameIndex = 0;
+   uint32_t numFramesObserved = 0;
+};
+
+} // namespace DotMatrix
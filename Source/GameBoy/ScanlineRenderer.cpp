@@ -0,0 +1,637 @@
+#include "Core/Assert.h"
+#include "Core/Math.h"
+
+#include "GameBoy/FramebufferSink.h"
+#include "GameBoy/ScanlineRenderer.h"
+
+#include <cstring>
+#include <utility>
+
+namespace DotMatrix
+{
+
+namespace
+{
+   namespace LCDC
+   {
+      enum Enum : uint8_t
+      {
+         DisplayEnable = 1 << 7,
+         WindowTileMapDisplaySelect = 1 << 6,
+         WindowDisplayEnable = 1 << 5,
+         BGAndWindowTileDataSelect = 1 << 4,
+         BGTileMapDisplaySelect = 1 << 3,
+         ObjSpriteSize = 1 << 2,
+         ObjSpriteDisplayEnable = 1 << 1,
+         BGDisplay = 1 << 0
+      };
+   }
+
+   namespace Attrib
+   {
+      enum Enum : uint8_t
+      {
+         ObjToBgPriority = 1 << 7,
+         YFlip = 1 << 6,
+         XFlip = 1 << 5,
+         PaletteNumber = 1 << 4, // Non-CGB only
+         TileVRAMBank = 1 << 3, // CGB only
+         CGBPaletteNumber = (1 << 2) | (1 << 1) | (1 << 0) // CGB only
+      };
+   }
+
+   using UnpackedByte = std::array<uint8_t, kPixelsPerPackedByte>;
+
+   constexpr std::array<UnpackedByte, 256> createUnpackedBytes()
+   {
+      std::array<UnpackedByte, 256> unpackedBytes = {};
+      for (size_t value = 0; value < unpackedBytes.size(); ++value)
+      {
+         for (size_t pixel = 0; pixel < kPixelsPerPackedByte; ++pixel)
+         {
+            unpackedBytes[value][pixel] = (value >> ((kPixelsPerPackedByte - 1 - pixel) * 2)) & 0x03;
+         }
+      }
+
+      return unpackedBytes;
+   }
+
+   // The shades of every possible packed byte, so unpacking is a lookup and a copy per byte
+   constexpr std::array<UnpackedByte, 256> kUnpackedBytes = createUnpackedBytes();
+}
+
+std::array<uint8_t, 4> extractPaletteColors(uint8_t palette)
+{
+   static const uint8_t kMask = 0x03;
+
+   std::array<uint8_t, 4> colors;
+   for (std::size_t i = 0; i < colors.size(); ++i)
+   {
+      std::size_t shift = i * 2;
+      colors[i] = (palette & (kMask << shift)) >> shift;
+   }
+
+   return colors;
+}
+
+void packLine(const uint8_t* shades, uint8_t* packedLine)
+{
+   for (size_t i = 0; i < kPackedLineSize; ++i, shades += kPixelsPerPackedByte)
+   {
+      packedLine[i] = ((shades[0] & 0x03) << 6) | ((shades[1] & 0x03) << 4) | ((shades[2] & 0x03) << 2) | (shades[3] & 0x03);
+   }
+}
+
+void unpackLine(const uint8_t* packedLine, uint8_t* shades)
+{
+   for (size_t i = 0; i < kPackedLineSize; ++i, shades += kPixelsPerPackedByte)
+   {
+      std::memcpy(shades, kUnpackedBytes[packedLine[i]].data(), kPixelsPerPackedByte);
+   }
+}
+
+void unpackFramebuffer(const PackedFramebuffer& packedFramebuffer, Framebuffer& framebuffer)
+{
+   for (size_t line = 0; line < kScreenHeight; ++line)
+   {
+      unpackLine(&packedFramebuffer[line * kPackedLineSize], &framebuffer[line * kScreenWidth]);
+   }
+}
+
+uint8_t ScanState::ControlRegister::read() const
+{
+   return lcdDisplayEnabled * LCDC::DisplayEnable
+      | windowUseUpperTileMap * LCDC::WindowTileMapDisplaySelect
+      | windowDisplayEnabled * LCDC::WindowDisplayEnable
+      | bgAndWindowUseUnsignedTileData * LCDC::BGAndWindowTileDataSelect
+      | bgUseUpperTileMap * LCDC::BGTileMapDisplaySelect
+      | useLargeSpriteSize * LCDC::ObjSpriteSize
+      | spriteDisplayEnabled * LCDC::ObjSpriteDisplayEnable
+      | bgWindowDisplayEnabled * LCDC::BGDisplay;
+}
+
+void ScanState::ControlRegister::write(uint8_t value)
+{
+   lcdDisplayEnabled = value & LCDC::DisplayEnable;
+   windowUseUpperTileMap = value & LCDC::WindowTileMapDisplaySelect;
+   windowDisplayEnabled = value & LCDC::WindowDisplayEnable;
+   bgAndWindowUseUnsignedTileData = value & LCDC::BGAndWindowTileDataSelect;
+   bgUseUpperTileMap = value & LCDC::BGTileMapDisplaySelect;
+   useLargeSpriteSize = value & LCDC::ObjSpriteSize;
+   spriteDisplayEnabled = value & LCDC::ObjSpriteDisplayEnable;
+   bgWindowDisplayEnabled = value & LCDC::BGDisplay;
+}
+
+void ScanState::write(uint16_t address, uint8_t value)
+{
+   if (address >= 0x8000 && address <= 0x9FFF)
+   {
+      vram[address - 0x8000] = value;
+   }
+   else if (address >= 0xFE00 && address <= 0xFEFF)
+   {
+      oam[address - 0xFE00] = value;
+   }
+   else
+   {
+      switch (address)
+      {
+      case 0xFF40: // LCD control
+         controlRegister.write(value);
+         break;
+      case 0xFF42: // Scroll y
+         scy = value;
+         break;
+      case 0xFF43: // Scroll x
+         scx = value;
+         break;
+      case 0xFF47: // BG & window palette data
+         bgp = value;
+         break;
+      case 0xFF48: // Object palette 0 data
+         obp0 = value;
+         break;
+      case 0xFF49: // Object palette 1 data
+         obp1 = value;
+         break;
+      case 0xFF4A: // Window y position
+         wy = value;
+         break;
+      case 0xFF4B: // Window x position
+         wx = value;
+         break;
+      default:
+         break;
+      }
+   }
+}
+
+ScanlineRenderer::ScanlineRenderer()
+   : unpackedStorage(std::make_unique<FrameStorage<Frame>>())
+{
+}
+
+void ScanlineRenderer::scan(const ScanState& state, uint8_t line)
+{
+   // Lines are never scanned while the LCD is off
+   DM_ASSERT(state.controlRegister.lcdDisplayEnabled);
+   DM_ASSERT(line < kScreenHeight);
+
+   std::array<uint8_t, 4> paletteColors = extractPaletteColors(state.bgp);
+
+   Line shades;
+   // Raw (unmapped) background / window color indices for this line, which sprite priority is based on
+   Line bgColorIndices;
+
+   if (state.controlRegister.bgWindowDisplayEnabled)
+   {
+      scanBackgroundOrWindow<false>(state, shades, bgColorIndices, line, paletteColors);
+   }
+   else
+   {
+      // The background and window are blank (white) while disabled
+      shades.fill(0);
+      bgColorIndices.fill(0);
+   }
+
+   if (state.controlRegister.bgWindowDisplayEnabled && state.controlRegister.windowDisplayEnabled)
+   {
+      scanBackgroundOrWindow<true>(state, shades, bgColorIndices, line, paletteColors);
+   }
+
+   if (state.controlRegister.spriteDisplayEnabled)
+   {
+      scanSprites(state, shades, bgColorIndices, line);
+   }
+
+   finishLine(shades, line);
+}
+
+void ScanlineRenderer::clearFrame()
+{
+   if (packedStorage)
+   {
+      packedStorage->frames.writeBuffer().pixels.fill(0x00);
+   }
+   else
+   {
+      unpackedStorage->frames.writeBuffer().pixels.fill(0x00);
+   }
+   pendingDirtyLines.set();
+
+   writeSinkLines();
+}
+
+void ScanlineRenderer::blankFrame()
+{
+   static const Line kBlankLine = {};
+
+   for (uint8_t line = 0; line < kScreenHeight; ++line)
+   {
+      finishLine(kBlankLine, line);
+   }
+
+   publishFrame();
+}
+
+void ScanlineRenderer::publishFrame()
+{
+   auto publish = [this](auto& frames)
+   {
+      auto& frame = frames.writeBuffer();
+      frame.dirtyLines = pendingDirtyLines;
+      frame.sequence = ++frameCounter;
+      frames.publish();
+   };
+
+   if (packedStorage)
+   {
+      publish(packedStorage->frames);
+   }
+   else
+   {
+      publish(unpackedStorage->frames);
+   }
+
+   if (framebufferSink)
+   {
+      framebufferSink->onFrameCompleted(pendingDirtyLines);
+   }
+   pendingDirtyLines.reset();
+}
+
+void ScanlineRenderer::setFramebufferSink(FramebufferSink* sink)
+{
+   framebufferSink = sink;
+
+   if (framebufferSink)
+   {
+      // Lines are only written as they are scanned, so bring the sink in line with the frame in progress
+      writeSinkLines();
+
+      // The sink's last frame may not match the last frame produced here
+      pendingDirtyLines.set();
+   }
+}
+
+void ScanlineRenderer::setFramebufferFormat(FramebufferFormat format)
+{
+   if (format == getFramebufferFormat())
+   {
+      return;
+   }
+
+   if (format == FramebufferFormat::Packed)
+   {
+      packedStorage = std::make_unique<FrameStorage<PackedFrame>>();
+      unpackedStorage = nullptr;
+   }
+   else
+   {
+      unpackedStorage = std::make_unique<FrameStorage<Frame>>();
+      packedStorage = nullptr;
+   }
+
+   pendingDirtyLines.set();
+   writeSinkLines();
+}
+
+void ScanlineRenderer::finishLine(const Line& shades, uint8_t line)
+{
+   // Compare against the last version of the line while it is still hot in the cache
+   if (packedStorage)
+   {
+      std::array<uint8_t, kPackedLineSize> packedLine;
+      packLine(shades.data(), packedLine.data());
+
+      size_t lineOffset = line * kPackedLineSize;
+      uint8_t* previousLine = &packedStorage->previousPixels[lineOffset];
+      if (std::memcmp(packedLine.data(), previousLine, kPackedLineSize) != 0)
+      {
+         std::memcpy(previousLine, packedLine.data(), kPackedLineSize);
+         pendingDirtyLines.set(line);
+      }
+
+      std::memcpy(&packedStorage->frames.writeBuffer().pixels[lineOffset], packedLine.data(), kPackedLineSize);
+   }
+   else
+   {
+      size_t lineOffset = line * kScreenWidth;
+      uint8_t* previousLine = &unpackedStorage->previousPixels[lineOffset];
+      if (std::memcmp(shades.data(), previousLine, kScreenWidth) != 0)
+      {
+         std::memcpy(previousLine, shades.data(), kScreenWidth);
+         pendingDirtyLines.set(line);
+      }
+
+      std::memcpy(&unpackedStorage->frames.writeBuffer().pixels[lineOffset], shades.data(), kScreenWidth);
+   }
+
+   if (framebufferSink)
+   {
+      framebufferSink->writeLine(line, shades.data());
+   }
+}
+
+void ScanlineRenderer::writeSinkLines()
+{
+   if (!framebufferSink)
+   {
+      return;
+   }
+
+   Line shades;
+   for (uint8_t line = 0; line < kScreenHeight; ++line)
+   {
+      if (packedStorage)
+      {
+         unpackLine(&packedStorage->frames.writeBuffer().pixels[line * kPackedLineSize], shades.data());
+      }
+      else
+      {
+         std::memcpy(shades.data(), &unpackedStorage->frames.writeBuffer().pixels[line * kScreenWidth], kScreenWidth);
+      }
+
+      framebufferSink->writeLine(line, shades.data());
+   }
+}
+
+template<bool isWindow>
+void ScanlineRenderer::scanBackgroundOrWindow(const ScanState& state, Line& shades, Line& bgColorIndices, uint8_t line, const std::array<uint8_t, 4>& paletteColors)
+{
+   // 32x32 tiles, 8x8 pixels each
+   static const uint16_t kTileWidth = 8;
+   static const uint16_t kTileHeight = 8;
+   static const uint16_t kNumTilesPerLine = 32;
+   static const uint16_t kWindowXOffset = 7;
+
+   uint8_t y = line;
+   if (isWindow && y < state.wy)
+   {
+      // Haven't reached the window yet
+      return;
+   }
+
+   int16_t yOffset = isWindow ? -state.wy : state.scy;
+   int16_t xOffset = isWindow ? (kWindowXOffset - state.wx) : state.scx;
+
+   uint8_t adjustedY = y + yOffset;
+   uint8_t row = adjustedY % kTileHeight;
+   uint16_t tileMapYOffset = (adjustedY / kTileHeight) * kNumTilesPerLine;
+
+   bool tileMapDisplaySelect = isWindow ? state.controlRegister.windowUseUpperTileMap : state.controlRegister.bgUseUpperTileMap;
+   uint16_t tileMapBase = tileMapDisplaySelect ? 0x1C00 : 0x1800;
+   bool signedTileOffset = !state.controlRegister.bgAndWindowUseUnsignedTileData;
+
+   uint8_t x = 0;
+   if (isWindow && xOffset < 0)
+   {
+      x -= xOffset;
+   }
+
+   while (x < kScreenWidth)
+   {
+      uint8_t adjustedX = x + xOffset;
+      uint8_t tileMapXOffset = adjustedX / kTileWidth;
+      uint8_t col = adjustedX % kTileWidth;
+
+      uint16_t tileMapOffset = tileMapXOffset + tileMapYOffset;
+      uint8_t tileNum = state.vram[tileMapBase + tileMapOffset];
+      TileLine tileLine = fetchTileLine(state, tileNum, row, signedTileOffset);
+
+      for (; col < kTileWidth && x < kScreenWidth; ++col, ++x)
+      {
+         uint8_t mask = (0b10000000 >> col); // bit 7 is the leftmost pixel, bit 0 is the rightmost pixel
+         uint8_t paletteIndex = static_cast<bool>(tileLine.firstByte & mask) + 2 * static_cast<bool>(tileLine.secondByte & mask);
+
+         shades[x] = paletteColors[paletteIndex];
+         bgColorIndices[x] = paletteIndex;
+      }
+   }
+}
+
+void ScanlineRenderer::scanSprites(const ScanState& state, Line& shades, const Line& bgColorIndices, uint8_t line)
+{
+   static const uint16_t kSpriteWidth = 8;
+   static const uint16_t kShortSpriteHeight = 8;
+   static const uint16_t kTallSpriteHeight = 16;
+   static const uint16_t kNumSprites = 40;
+
+   uint8_t y = line;
+   uint8_t spriteHeight = state.controlRegister.useLargeSpriteSize ? kTallSpriteHeight : kShortSpriteHeight;
+
+   for (int8_t sprite = kNumSprites - 1; sprite >= 0; --sprite)
+   {
+      ScanState::SpriteAttributes attributes = state.spriteAttributes[sprite];
+
+      int16_t spriteY = attributes.yPos - kTallSpriteHeight;
+      if (spriteY > y || spriteY + spriteHeight <= y
+         || attributes.xPos == 0 || attributes.xPos >= kScreenWidth + kSpriteWidth)
+      {
+         continue;
+      }
+
+      bool useObp1 = (attributes.flags & Attrib::PaletteNumber) != 0x00;
+      std::array<uint8_t, 4> paletteColors = extractPaletteColors(useObp1 ? state.obp1 : state.obp0);
+
+      uint8_t row = y - spriteY;
+      if (attributes.flags & Attrib::YFlip)
+      {
+         row = (kTallSpriteHeight - 1) - row;
+      }
+      row %= spriteHeight;
+
+      bool flipX = (attributes.flags & Attrib::XFlip) != 0x00;
+      TileLine tileLine = fetchTileLine(state, attributes.tileNum, row, false);
+
+      for (uint8_t col = 0; col < kSpriteWidth; ++col)
+      {
+         int16_t x = attributes.xPos - kSpriteWidth + col;
+         if (x < 0 || x >= static_cast<int16_t>(kScreenWidth))
+         {
+            continue;
+         }
+
+         uint8_t mask = flipX ? (0b00000001 << col) : (0b10000000 >> col); // bit 7 is the leftmost pixel, bit 0 is the rightmost pixel
+         uint8_t paletteIndex = static_cast<bool>(tileLine.firstByte & mask) + 2 * static_cast<bool>(tileLine.secondByte & mask);
+
+         // Sprite palette index 0 is transparent
+         bool aboveBackground = paletteIndex != 0;
+
+         // If the OBJ-to-BG priority bit is set, the sprite is behind background / window colors 1-3 (before the palette is applied)
+         if (attributes.flags & Attrib::ObjToBgPriority)
+         {
+            DM_ASSERT(bgColorIndices[x] <= 3);
+            aboveBackground = aboveBackground && bgColorIndices[x] == 0;
+         }
+
+         if (aboveBackground)
+         {
+            shades[x] = paletteColors[paletteIndex];
+         }
+      }
+   }
+}
+
+// static
+ScanlineRenderer::TileLine ScanlineRenderer::fetchTileLine(const ScanState& state, uint8_t tileNum, uint8_t line, bool signedTileOffset)
+{
+   static const uint8_t kBytesPerTile = 16;
+   static const uint8_t kBytesPerLine = 2;
+   static const uint16_t kSignedTileDataAddr = 0x0800;
+   static const uint16_t kUnsignedTileDataAddr = 0x0000;
+
+   uint16_t tileDataBase;
+   uint16_t tileDataTileOffset;
+   if (signedTileOffset)
+   {
+      tileDataBase = kSignedTileDataAddr;
+      tileDataTileOffset = (Math::reinterpretAsSigned(tileNum) + 128) * kBytesPerTile;
+   }
+   else
+   {
+      tileDataBase = kUnsignedTileDataAddr;
+      tileDataTileOffset = tileNum * kBytesPerTile;
+   }
+   uint8_t tileDataLineOffset = line * kBytesPerLine;
+   uint16_t totalOffset = tileDataBase + tileDataTileOffset + tileDataLineOffset;
+
+   TileLine tileLine;
+   tileLine.firstByte = state.vram[totalOffset];
+   tileLine.secondByte = state.vram[totalOffset + 1];
+
+   return tileLine;
+}
+
+#if !DM_PROJECT_PLAYDATE
+ScanlineRenderWorker::ScanlineRenderWorker(ScanlineRenderer& scanlineRenderer, const ScanState& currentState)
+   : renderer(scanlineRenderer)
+{
+   // Enough for a frame's worth of typical VRAM / OAM traffic without reallocating
+   static const std::size_t kInitialLogCapacity = 8 * 1024;
+
+   currentJob.initialState = currentState;
+   currentJob.log.reserve(kInitialLogCapacity);
+   pendingJob.log.reserve(kInitialLogCapacity);
+   activeJob.log.reserve(kInitialLogCapacity);
+
+   thread = std::thread([this]
+   {
+      threadMain();
+   });
+}
+
+ScanlineRenderWorker::~ScanlineRenderWorker()
+{
+   {
+      std::unique_lock<std::mutex> lock(mutex);
+      conditionVariable.wait(lock, [this]() { return !jobPending; });
+
+      if (!currentJob.log.empty())
+      {
+         pendingJob.initialState = currentJob.initialState;
+         std::swap(pendingJob.log, currentJob.log);
+         jobPending = true;
+      }
+
+      exiting = true;
+   }
+
+   conditionVariable.notify_all();
+   thread.join();
+}
+
+void ScanlineRenderWorker::logPublishFrame(const ScanState& currentState)
+{
+   currentJob.log.push_back({ Command::PublishFrame, 0, 0 });
+   submit(currentState);
+}
+
+void ScanlineRenderWorker::logBlankFrame(const ScanState& currentState)
+{
+   currentJob.log.push_back({ Command::BlankFrame, 0, 0 });
+   submit(currentState);
+}
+
+void ScanlineRenderWorker::flush(const ScanState& currentState)
+{
+   submit(currentState);
+
+   std::unique_lock<std::mutex> lock(mutex);
+   conditionVariable.wait(lock, [this]() { return !jobPending && !jobActive; });
+}
+
+void ScanlineRenderWorker::submit(const ScanState& currentState)
+{
+   {
+      // Waiting here keeps emulation at most one frame ahead of rendering
+      std::unique_lock<std::mutex> lock(mutex);
+      conditionVariable.wait(lock, [this]() { return !jobPending; });
+
+      pendingJob.initialState = currentJob.initialState;
+      std::swap(pendingJob.log, currentJob.log);
+      jobPending = true;
+   }
+
+   conditionVariable.notify_all();
+
+   // Everything logged from here on applies on top of the current state
+   currentJob.initialState = currentState;
+   currentJob.log.clear();
+}
+
+void ScanlineRenderWorker::threadMain()
+{
+   std::unique_lock<std::mutex> lock(mutex);
+
+   while (true)
+   {
+      conditionVariable.wait(lock, [this]() { return jobPending || exiting; });
+      if (!jobPending)
+      {
+         break;
+      }
+
+      activeJob.initialState = pendingJob.initialState;
+      std::swap(activeJob.log, pendingJob.log);
+      jobPending = false;
+      jobActive = true;
+
+      lock.unlock();
+      conditionVariable.notify_all();
+
+      ScanState& state = activeJob.initialState;
+      for (const LogEntry& entry : activeJob.log)
+      {
+         switch (entry.command)
+         {
+         case Command::Write:
+            state.write(entry.address, entry.value);
+            break;
+         case Command::Scan:
+            renderer.scan(state, entry.value);
+            break;
+         case Command::ClearFrame:
+            renderer.clearFrame();
+            break;
+         case Command::BlankFrame:
+            renderer.blankFrame();
+            break;
+         case Command::PublishFrame:
+            renderer.publishFrame();
+            break;
+         default:
+            DM_ASSERT(false);
+            break;
+         }
+      }
+      activeJob.log.clear();
+
+      lock.lock();
+      jobActive = false;
+      conditionVariable.notify_all();
+   }
+}
+#endif // !DM_PROJECT_PLAYDATE
+
+} // namespace DotMatrix
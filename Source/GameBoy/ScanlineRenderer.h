@@ -0,0 +1,278 @@
+#pragma once
+
+#include "Core/Assert.h"
+#include "Core/TripleBuffer.h"
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#if !DM_PROJECT_PLAYDATE
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#endif // !DM_PROJECT_PLAYDATE
+
+namespace DotMatrix
+{
+
+class FramebufferSink;
+
+constexpr size_t kScreenWidth = 160;
+constexpr size_t kScreenHeight = 144;
+
+constexpr size_t kPixelsPerPackedByte = 4;
+constexpr size_t kPackedLineSize = kScreenWidth / kPixelsPerPackedByte;
+
+using Framebuffer = std::array<uint8_t, kScreenWidth * kScreenHeight>;
+// Four 2-bit shades per byte, with the leftmost pixel in the upper two bits
+using PackedFramebuffer = std::array<uint8_t, kPackedLineSize * kScreenHeight>;
+using LineMask = std::bitset<kScreenHeight>;
+
+// A completed frame, as handed from emulation to presentation
+template<typename Pixels>
+struct BasicFrame
+{
+   Pixels pixels = {};
+   LineMask dirtyLines; // Lines that differ from the previous frame
+   uint32_t sequence = 0; // Number of frames completed up to and including this one
+};
+
+using Frame = BasicFrame<Framebuffer>;
+using PackedFrame = BasicFrame<PackedFramebuffer>;
+
+enum class FramebufferFormat : uint8_t
+{
+   Unpacked, // One shade per byte
+   Packed // Four shades per byte, a quarter of the memory for instances that don't need to present every pixel as a byte
+};
+
+std::array<uint8_t, 4> extractPaletteColors(uint8_t palette);
+
+// shades points to kScreenWidth shades, packedLine to kPackedLineSize bytes
+void packLine(const uint8_t* shades, uint8_t* packedLine);
+void unpackLine(const uint8_t* packedLine, uint8_t* shades);
+void unpackFramebuffer(const PackedFramebuffer& packedFramebuffer, Framebuffer& framebuffer);
+
+inline uint8_t getPackedShade(const PackedFramebuffer& packedFramebuffer, size_t x, size_t y)
+{
+   DM_ASSERT(x < kScreenWidth && y < kScreenHeight);
+
+   uint8_t packedByte = packedFramebuffer[y * kPackedLineSize + x / kPixelsPerPackedByte];
+   size_t shift = (kPixelsPerPackedByte - 1 - x % kPixelsPerPackedByte) * 2;
+   return (packedByte >> shift) & 0x03;
+}
+
+// Everything that scanning a line depends on
+struct ScanState
+{
+   struct ControlRegister
+   {
+      bool lcdDisplayEnabled = true;
+      bool windowUseUpperTileMap = false;
+      bool windowDisplayEnabled = false;
+      bool bgAndWindowUseUnsignedTileData = true;
+      bool bgUseUpperTileMap = false;
+      bool useLargeSpriteSize = false;
+      bool spriteDisplayEnabled = false;
+      bool bgWindowDisplayEnabled = true;
+
+      uint8_t read() const;
+      void write(uint8_t value);
+   };
+
+   struct SpriteAttributes
+   {
+      uint8_t yPos = 0;
+      uint8_t xPos = 0;
+      uint8_t tileNum = 0;
+      uint8_t flags = 0;
+   };
+
+   ScanState()
+   {
+   }
+
+   // Applies a write to VRAM, OAM or one of the registers above (anything else is ignored)
+   void write(uint16_t address, uint8_t value);
+
+   ControlRegister controlRegister;
+
+   uint8_t scy = 0;
+   uint8_t scx = 0;
+   uint8_t bgp = 0xFC;
+   uint8_t obp0 = 0;
+   uint8_t obp1 = 0;
+   uint8_t wy = 0;
+   uint8_t wx = 0;
+
+   std::array<uint8_t, 0x2000> vram = {};
+   union
+   {
+      std::array<SpriteAttributes, 0x0040> spriteAttributes;
+      std::array<uint8_t, 0x0100> oam = {};
+   };
+};
+
+// Turns scan states into lines of 2-bit shades, and hands off completed frames
+class ScanlineRenderer
+{
+public:
+   ScanlineRenderer();
+
+   void scan(const ScanState& state, uint8_t line);
+   // Fills the frame in progress with white, without completing it
+   void clearFrame();
+   // Completes a white frame
+   void blankFrame();
+   void publishFrame();
+
+   void setFramebufferSink(FramebufferSink* sink);
+
+   // Only the storage for the selected format is allocated, switching discards the frame in progress along with any completed ones
+   void setFramebufferFormat(FramebufferFormat format);
+
+   FramebufferFormat getFramebufferFormat() const
+   {
+      return packedStorage ? FramebufferFormat::Packed : FramebufferFormat::Unpacked;
+   }
+
+   bool acquireLatestFrame()
+   {
+      return packedStorage ? packedStorage->frames.acquire() : unpackedStorage->frames.acquire();
+   }
+
+   // Only valid with FramebufferFormat::Unpacked
+   const Frame& getLatestFrame() const
+   {
+      DM_ASSERT(unpackedStorage);
+      return unpackedStorage->frames.readBuffer();
+   }
+
+   // Only valid with FramebufferFormat::Packed
+   const PackedFrame& getLatestPackedFrame() const
+   {
+      DM_ASSERT(packedStorage);
+      return packedStorage->frames.readBuffer();
+   }
+
+   const LineMask& getLatestDirtyLines() const
+   {
+      return packedStorage ? packedStorage->frames.readBuffer().dirtyLines : unpackedStorage->frames.readBuffer().dirtyLines;
+   }
+
+   uint32_t getLatestSequence() const
+   {
+      return packedStorage ? packedStorage->frames.readBuffer().sequence : unpackedStorage->frames.readBuffer().sequence;
+   }
+
+private:
+   struct TileLine
+   {
+      uint8_t firstByte = 0x00;
+      uint8_t secondByte = 0x00;
+   };
+
+   template<typename FrameType>
+   struct FrameStorage
+   {
+      TripleBuffer<FrameType> frames;
+      decltype(FrameType::pixels) previousPixels = {}; // The most recently scanned version of each line, for finding dirty lines
+   };
+
+   using Line = std::array<uint8_t, kScreenWidth>;
+
+   template<bool isWindow>
+   void scanBackgroundOrWindow(const ScanState& state, Line& shades, Line& bgColorIndices, uint8_t line, const std::array<uint8_t, 4>& paletteColors);
+   void scanSprites(const ScanState& state, Line& shades, const Line& bgColorIndices, uint8_t line);
+   void finishLine(const Line& shades, uint8_t line);
+   void writeSinkLines();
+
+   static TileLine fetchTileLine(const ScanState& state, uint8_t tileNum, uint8_t line, bool signedTileOffset);
+
+   // Exactly one of these is allocated, depending on the format
+   std::unique_ptr<FrameStorage<Frame>> unpackedStorage;
+   std::unique_ptr<FrameStorage<PackedFrame>> packedStorage;
+
+   uint32_t frameCounter = 0;
+   FramebufferSink* framebufferSink = nullptr;
+   LineMask pendingDirtyLines = LineMask().set(); // Not every line is scanned during the first frame, so treat all of them as changed
+};
+
+#if !DM_PROJECT_PLAYDATE
+// Renders on a worker thread instead of inline with emulation
+// The emulation side only logs what the renderer would have seen (writes, scans and completed frames), and each frame's log is replayed against a snapshot of the scan state taken when the previous frame was handed off
+// The output is identical to rendering inline, but the pixel work for one frame overlaps with emulating the next
+class ScanlineRenderWorker
+{
+public:
+   ScanlineRenderWorker(ScanlineRenderer& scanlineRenderer, const ScanState& currentState);
+   // Renders everything logged so far before returning
+   ~ScanlineRenderWorker();
+
+   void logWrite(uint16_t address, uint8_t value)
+   {
+      currentJob.log.push_back({ Command::Write, value, address });
+   }
+
+   void logScan(uint8_t line)
+   {
+      currentJob.log.push_back({ Command::Scan, line, 0 });
+   }
+
+   void logClearFrame()
+   {
+      currentJob.log.push_back({ Command::ClearFrame, 0, 0 });
+   }
+
+   // Hands the frame off to the worker (waiting for it to pick up the previous one if it hasn't yet)
+   void logPublishFrame(const ScanState& currentState);
+   void logBlankFrame(const ScanState& currentState);
+
+   // Waits until everything logged so far has been rendered
+   void flush(const ScanState& currentState);
+
+private:
+   enum class Command : uint8_t
+   {
+      Write,
+      Scan,
+      ClearFrame,
+      BlankFrame,
+      PublishFrame
+   };
+
+   struct LogEntry
+   {
+      Command command;
+      uint8_t value;
+      uint16_t address;
+   };
+
+   struct Job
+   {
+      ScanState initialState;
+      std::vector<LogEntry> log;
+   };
+
+   void submit(const ScanState& currentState);
+   void threadMain();
+
+   ScanlineRenderer& renderer;
+
+   Job currentJob; // Only touched by the emulation side
+   Job pendingJob;
+   Job activeJob; // Only touched by the worker
+
+   std::thread thread;
+   std::mutex mutex;
+   std::condition_variable conditionVariable;
+   bool jobPending = false;
+   bool jobActive = false;
+   bool exiting = false;
+};
+#endif // !DM_PROJECT_PLAYDATE
+
+} // namespace DotMatrix
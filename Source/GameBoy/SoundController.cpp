@@ -2,6 +2,7 @@
 #include "GameBoy/GameBoy.h"
 #include "GameBoy/SoundController.h"
 
+#include <algorithm>
 #include <cmath>
 
 namespace DotMatrix
@@ -526,49 +527,82 @@ void Mixer::writeNr51(uint8_t value)
    noiseRightEnabled = (value & 0x08) != 0x00;
 }
 
+SoundController::SinkOutput::SinkOutput(AudioSink& audioSink)
+   : sink(audioSink)
+   , withStems(audioSink.wantsStems())
+   , leftBlipBuffer(kMaxSamplesPerAudioFrame)
+   , rightBlipBuffer(kMaxSamplesPerAudioFrame)
+{
+   uint32_t sinkSampleRate = sink.getSampleRate();
+   DM_ASSERT(sinkSampleRate >= kMinSampleRate && sinkSampleRate <= kMaxSampleRate, "Unsupported sample rate: %u", sinkSampleRate);
+   sinkSampleRate = std::clamp(sinkSampleRate, kMinSampleRate, kMaxSampleRate);
+
+   leftBlipBuffer.setRates(CPU::kClockSpeed, sinkSampleRate);
+   rightBlipBuffer.setRates(CPU::kClockSpeed, sinkSampleRate);
+
+   if (withStems)
+   {
+      stemBlipBuffers.reserve(stemOutput.size());
+      for (std::size_t i = 0; i < stemOutput.size(); ++i)
+      {
+         stemBlipBuffers.emplace_back(kMaxSamplesPerAudioFrame);
+         stemBlipBuffers.back().setRates(CPU::kClockSpeed, sinkSampleRate);
+      }
+   }
+}
+
 SoundController::SoundController()
    : frameSequencer(*this)
    , squareWaveChannel1(true)
    , squareWaveChannel2(false)
+   , leftBlipBuffer(kMaxSamplesPerAudioFrame)
+   , rightBlipBuffer(kMaxSamplesPerAudioFrame)
 {
+   leftBlipBuffer.setRates(CPU::kClockSpeed, outputRate);
+   rightBlipBuffer.setRates(CPU::kClockSpeed, outputRate);
 }
 
-void SoundController::machineCycle()
+void SoundController::setAudioPolicy(AudioPolicy newAudioPolicy)
 {
-   static const double kIdealCyclesPerSample = static_cast<double>(CPU::kClockSpeed) / kSampleRate;
-   static const uint8_t kDefaultCyclesPerSample = static_cast<uint8_t>(kIdealCyclesPerSample);
-   static const float kCycleRemainder = static_cast<float>(kIdealCyclesPerSample - kDefaultCyclesPerSample);
-
-   frameSequencer.machineCycle();
-
-   squareWaveChannel1.machineCycle();
-   squareWaveChannel2.machineCycle();
-   waveChannel.machineCycle();
-   noiseChannel.machineCycle();
+   // Cycles that have already passed run with the old policy, then catching up again (with nothing pending) schedules the next catch up for the new one
+   catchUp();
+   audioPolicy = newAudioPolicy;
+   catchUp();
+}
 
-   cyclesSinceLastSample += CPU::kClockCyclesPerMachineCycle;
+void SoundController::setAudioSink(AudioSink* newAudioSink)
+{
+   catchUp();
 
-   if (cyclesSinceLastSample >= cyclesForNextSample)
+   if (sinkOutput)
    {
-      cyclesSinceLastSample -= cyclesForNextSample;
-      remainderCycles += kCycleRemainder;
+      flushAudioSink();
+      sinkOutput = nullptr;
+   }
 
-      cyclesForNextSample = kDefaultCyclesPerSample;
-      if (remainderCycles >= 1.0f)
+   if (newAudioSink)
+   {
+      // Deltas are only added from the current clock on, so the new sink's first samples (up to the end of the current audio frame) start out silent
+      sinkOutput = std::make_unique<SinkOutput>(*newAudioSink);
+      if (audioPolicy == AudioPolicy::Synthesize)
       {
-         remainderCycles -= 1.0f;
-         DM_ASSERT(remainderCycles < 1.0f);
-
-         ++cyclesForNextSample;
+         updateOutput();
       }
-      DM_ASSERT(cyclesSinceLastSample < cyclesForNextSample);
+   }
+}
 
-      pushSample();
+void SoundController::machineCycle()
+{
+   pendingCycles += CPU::kClockCyclesPerMachineCycle;
+   if (pendingCycles >= cyclesUntilCatchUp)
+   {
+      catchUp();
    }
 }
 
 uint8_t SoundController::read(uint16_t address) const
 {
+   // No need to catch up, register state only changes when the frame sequencer is clocked (which always catches up) or when written
    uint8_t value = GameBoy::kInvalidAddressByte;
 
    if (address >= 0xFF10 && address <= 0xFF14)
@@ -615,6 +649,8 @@ uint8_t SoundController::read(uint16_t address) const
 
 void SoundController::write(uint16_t address, uint8_t value)
 {
+   catchUp();
+
    if (!powerEnabled && address != 0xFF26)
    {
       // TODO Except length counters?
@@ -659,6 +695,12 @@ void SoundController::write(uint16_t address, uint8_t value)
          break;
       }
    }
+
+   // Any write can change the output (e.g. triggers, volume, panning)
+   if (audioPolicy == AudioPolicy::Synthesize)
+   {
+      updateOutput();
+   }
 }
 
 uint8_t SoundController::readNr52() const
@@ -700,32 +742,272 @@ void SoundController::setPowerEnabled(bool newPowerEnabled)
    powerEnabled = newPowerEnabled;
 }
 
-void SoundController::pushSample()
+void SoundController::catchUp()
+{
+   if (audioPolicy == AudioPolicy::Silent)
+   {
+      // The channels' timers only drive their output (duty / wave position, LFSR), so only the frame sequencer needs to run
+      frameSequencer.advance(pendingCycles);
+      pendingCycles = 0;
+
+      cyclesUntilCatchUp = frameSequencer.getCyclesUntilClock() + CPU::kClockCyclesPerMachineCycle;
+      return;
+   }
+
+   while (pendingCycles > 0)
+   {
+      // The output can only change when one of the units is clocked, so skip straight to the next machine cycle in which that happens
+      uint32_t cycles = std::min({ pendingCycles, kAudioFrameClocks - audioFrameClocks, getCyclesUntilClock() });
+      if (cycles == 0)
+      {
+         cycles = CPU::kClockCyclesPerMachineCycle;
+      }
+
+      bool clocked = frameSequencer.advance(cycles);
+      clocked |= squareWaveChannel1.advance(cycles);
+      clocked |= squareWaveChannel2.advance(cycles);
+      clocked |= waveChannel.advance(cycles);
+      clocked |= noiseChannel.advance(cycles);
+
+#if DM_WITH_UI
+      if (uiTelemetryEnabled)
+      {
+         advanceUITelemetry(cycles);
+      }
+#endif // DM_WITH_UI
+
+      if (clocked)
+      {
+         updateOutput();
+      }
+
+      pendingCycles -= cycles;
+      audioFrameClocks += cycles;
+      if (audioFrameClocks >= kAudioFrameClocks)
+      {
+         endAudioFrame();
+      }
+   }
+
+   // Catch up again at the end of the audio frame, or after the next frame sequencer clock (which can change register state)
+   cyclesUntilCatchUp = std::min(kAudioFrameClocks - audioFrameClocks, frameSequencer.getCyclesUntilClock() + CPU::kClockCyclesPerMachineCycle);
+}
+
+uint32_t SoundController::getCyclesUntilClock() const
+{
+   return std::min({ frameSequencer.getCyclesUntilClock(), squareWaveChannel1.getCyclesUntilClock(), squareWaveChannel2.getCyclesUntilClock(), waveChannel.getCyclesUntilClock(), noiseChannel.getCyclesUntilClock() });
+}
+
+void SoundController::updateOutput()
 {
    int8_t square1Sample = squareWaveChannel1.getCurrentAudioSample();
    int8_t square2Sample = squareWaveChannel2.getCurrentAudioSample();
    int8_t waveSample = waveChannel.getCurrentAudioSample();
    int8_t noiseSample = noiseChannel.getCurrentAudioSample();
 
-   AudioSample sample = mixer.mix(square1Sample, square2Sample, waveSample, noiseSample);
+   AudioSample newOutput = mixer.mix(square1Sample, square2Sample, waveSample, noiseSample);
+
+   if (newOutput.left != output.left)
+   {
+      leftBlipBuffer.addDelta(audioFrameClocks, newOutput.left - output.left);
+   }
+   if (newOutput.right != output.right)
+   {
+      rightBlipBuffer.addDelta(audioFrameClocks, newOutput.right - output.right);
+   }
+
+   output = newOutput;
+
+#if DM_WITH_UI
+   if (uiTelemetryEnabled)
+   {
+      addToUIColumn({ square1Sample, square2Sample, waveSample, noiseSample });
+   }
+#endif // DM_WITH_UI
+
+   if (sinkOutput)
+   {
+      if (newOutput.left != sinkOutput->output.left)
+      {
+         sinkOutput->leftBlipBuffer.addDelta(audioFrameClocks, newOutput.left - sinkOutput->output.left);
+      }
+      if (newOutput.right != sinkOutput->output.right)
+      {
+         sinkOutput->rightBlipBuffer.addDelta(audioFrameClocks, newOutput.right - sinkOutput->output.right);
+      }
+
+      sinkOutput->output = newOutput;
+
+      if (sinkOutput->withStems)
+      {
+         // Full master volume, then the same shift as Mixer::mix()
+         static const int16_t kStemScale = 8 << 6;
+
+         std::array<int16_t, 4> newStemOutput = { static_cast<int16_t>(square1Sample * kStemScale), static_cast<int16_t>(square2Sample * kStemScale), static_cast<int16_t>(waveSample * kStemScale), static_cast<int16_t>(noiseSample * kStemScale) };
+         for (std::size_t i = 0; i < newStemOutput.size(); ++i)
+         {
+            if (newStemOutput[i] != sinkOutput->stemOutput[i])
+            {
+               sinkOutput->stemBlipBuffers[i].addDelta(audioFrameClocks, newStemOutput[i] - sinkOutput->stemOutput[i]);
+            }
+         }
+
+         sinkOutput->stemOutput = newStemOutput;
+      }
+   }
+}
+
+void SoundController::endAudioFrame()
+{
+   if (sinkOutput)
+   {
+      flushAudioSink();
+   }
+
+   leftBlipBuffer.endFrame(audioFrameClocks);
+   rightBlipBuffer.endFrame(audioFrameClocks);
+   audioFrameClocks = 0;
+
+   double newOutputRate = sampleRate * sampleRateScale;
+   if (newOutputRate != outputRate)
+   {
+      // Only changed between frames, so every delta in a frame is placed with the same rate
+      outputRate = newOutputRate;
+      leftBlipBuffer.setRates(CPU::kClockSpeed, outputRate);
+      rightBlipBuffer.setRates(CPU::kClockSpeed, outputRate);
+   }
+
+   std::array<int16_t, kMaxSamplesPerAudioFrame> leftSamples;
+   std::array<int16_t, kMaxSamplesPerAudioFrame> rightSamples;
+   std::size_t numSamples = leftBlipBuffer.readSamples(leftSamples);
+   std::size_t numRightSamples = rightBlipBuffer.readSamples(rightSamples);
+   DM_ASSERT(numSamples == numRightSamples);
 
 #if DM_PROJECT_PLAYDATE
-   leftAudioRingBuffer.push(sample.left);
-   rightAudioRingBuffer.push(sample.right);
+   // The right buffer always has at least as much free space as the left one (see consumeAudio()), so both get the same samples
+   std::size_t numPushed = leftAudioRingBuffer.push(std::span<const int16_t>(leftSamples.data(), numSamples));
+   rightAudioRingBuffer.push(std::span<const int16_t>(rightSamples.data(), numPushed));
 #else
-   audioRingBuffer.push(sample);
+   std::array<AudioSample, kMaxSamplesPerAudioFrame> samples;
+   for (std::size_t i = 0; i < numSamples; ++i)
+   {
+      samples[i].left = leftSamples[i];
+      samples[i].right = rightSamples[i];
+   }
+
+   audioRingBuffer.push(std::span<const AudioSample>(samples.data(), numSamples));
 #endif
+}
+
+void SoundController::flushAudioSink()
+{
+   DM_ASSERT(sinkOutput);
+
+   sinkOutput->leftBlipBuffer.endFrame(audioFrameClocks);
+   sinkOutput->rightBlipBuffer.endFrame(audioFrameClocks);
+
+   std::array<int16_t, kMaxSamplesPerAudioFrame> leftSamples;
+   std::array<int16_t, kMaxSamplesPerAudioFrame> rightSamples;
+   std::size_t numSamples = sinkOutput->leftBlipBuffer.readSamples(leftSamples);
+   std::size_t numRightSamples = sinkOutput->rightBlipBuffer.readSamples(rightSamples);
+   DM_ASSERT(numSamples == numRightSamples);
+
+   std::array<AudioSample, kMaxSamplesPerAudioFrame> samples;
+   for (std::size_t i = 0; i < numSamples; ++i)
+   {
+      samples[i].left = leftSamples[i];
+      samples[i].right = rightSamples[i];
+   }
+
+   std::array<StemSample, kMaxSamplesPerAudioFrame> stems;
+   std::size_t numStems = 0;
+   if (sinkOutput->withStems)
+   {
+      std::array<std::array<int16_t, kMaxSamplesPerAudioFrame>, 4> stemSamples;
+      for (std::size_t stem = 0; stem < stemSamples.size(); ++stem)
+      {
+         sinkOutput->stemBlipBuffers[stem].endFrame(audioFrameClocks);
+
+         std::size_t numStemSamples = sinkOutput->stemBlipBuffers[stem].readSamples(stemSamples[stem]);
+         DM_ASSERT(numStemSamples == numSamples);
+      }
+
+      for (std::size_t i = 0; i < numSamples; ++i)
+      {
+         stems[i].square1 = stemSamples[0][i];
+         stems[i].square2 = stemSamples[1][i];
+         stems[i].wave = stemSamples[2][i];
+         stems[i].noise = stemSamples[3][i];
+      }
+
+      numStems = numSamples;
+   }
+
+   sinkOutput->sink.writeSamples(std::span<const AudioSample>(samples.data(), numSamples), std::span<const StemSample>(stems.data(), numStems));
+}
 
 #if DM_WITH_UI
-   UIData uiData;
-   uiData.sample = sample;
-   uiData.square1 = square1Sample;
-   uiData.square2 = square2Sample;
-   uiData.wave = waveSample;
-   uiData.noise = noiseSample;
-
-   uiRingBuffer.push(uiData);
-#endif // DM_WITH_UI
+void SoundController::setUITelemetryEnabled(bool enabled)
+{
+   if (enabled == uiTelemetryEnabled)
+   {
+      return;
+   }
+
+   // Cycles that have already passed are handled with the old setting
+   catchUp();
+   uiTelemetryEnabled = enabled;
+
+   if (uiTelemetryEnabled)
+   {
+      // Anything gathered before was from a different point in time, so start over with the current output
+      uiChannelOutput = { squareWaveChannel1.getCurrentAudioSample(), squareWaveChannel2.getCurrentAudioSample(), waveChannel.getCurrentAudioSample(), noiseChannel.getCurrentAudioSample() };
+
+      UIColumn column;
+      column.min = output;
+      column.max = output;
+      column.channelMin = uiChannelOutput;
+      column.channelMax = uiChannelOutput;
+
+      uiColumns.fill(column);
+      uiColumnClocks = 0;
+   }
 }
 
+void SoundController::advanceUITelemetry(uint32_t cycles)
+{
+   uiColumnClocks += cycles;
+   while (uiColumnClocks >= kUIClocksPerColumn)
+   {
+      uiColumnClocks -= kUIClocksPerColumn;
+      uiColumnIndex = (uiColumnIndex + 1) % kNumUIColumns;
+
+      // The output holds until it next changes, so each column starts out with it
+      UIColumn& column = uiColumns[uiColumnIndex];
+      column.min = output;
+      column.max = output;
+      column.channelMin = uiChannelOutput;
+      column.channelMax = uiChannelOutput;
+   }
+}
+
+void SoundController::addToUIColumn(const std::array<int8_t, 4>& channelSamples)
+{
+   UIColumn& column = uiColumns[uiColumnIndex];
+
+   column.min.left = std::min(column.min.left, output.left);
+   column.min.right = std::min(column.min.right, output.right);
+   column.max.left = std::max(column.max.left, output.left);
+   column.max.right = std::max(column.max.right, output.right);
+
+   for (std::size_t i = 0; i < channelSamples.size(); ++i)
+   {
+      column.channelMin[i] = std::min(column.channelMin[i], channelSamples[i]);
+      column.channelMax[i] = std::max(column.channelMax[i], channelSamples[i]);
+   }
+
+   uiChannelOutput = channelSamples;
+}
+#endif // DM_WITH_UI
+
 } // namespace DotMatrix
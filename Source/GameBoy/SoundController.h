@@ -1,12 +1,17 @@
 #pragma once
 
+#include "Core/BlipBuffer.h"
 #include "Core/RingBuffer.h"
 
 #include "GameBoy/CPU.h"
 
+#include <algorithm>
 #include <array>
 #include <cstdint>
+#include <limits>
+#include <memory>
 #include <span>
+#include <vector>
 
 namespace DotMatrix
 {
@@ -20,6 +25,29 @@ struct AudioSample
    int16_t right = 0;
 };
 
+// Each channel on its own (before panning and master volume), at the same scale as a single centered channel in the mixed output
+struct StemSample
+{
+   int16_t square1 = 0;
+   int16_t square2 = 0;
+   int16_t wave = 0;
+   int16_t noise = 0;
+};
+
+// Receives synthesized audio on the emulation thread (e.g. for recording)
+// Synthesized separately from the regular output, at the sink's own rate, and unaffected by the sample rate scale
+class AudioSink
+{
+public:
+   virtual ~AudioSink() = default;
+
+   virtual uint32_t getSampleRate() const = 0;
+   virtual bool wantsStems() const = 0;
+
+   // stems has one entry per sample if wantsStems() returned true, and is empty otherwise
+   virtual void writeSamples(std::span<const AudioSample> samples, std::span<const StemSample> stems) = 0;
+};
+
 class SoundChannel
 {
 public:
@@ -52,21 +80,44 @@ public:
    {
    }
 
-   void machineCycle()
+   // Advances by any number of cycles, clocking the owner each time the counter runs out
+   // Returns the number of times the owner was clocked
+   uint32_t advance(uint32_t cycles)
    {
-      uint32_t cycles = CPU::kClockCyclesPerMachineCycle;
+      uint32_t numClocks = 0;
 
       if (period != 0)
       {
-         while (cycles >= counter)
+         if (cycles >= counter)
          {
             cycles -= counter;
-            owner.clock();
-            counter = period;
+            numClocks = 1 + cycles / period;
+            counter = period - cycles % period;
+
+            for (uint32_t i = 0; i < numClocks; ++i)
+            {
+               owner.clock();
+            }
          }
+         else
+         {
+            counter -= cycles;
+         }
+      }
+
+      return numClocks;
+   }
 
-         counter -= cycles;
+   // Number of cycles (in whole machine cycles) that can be advanced without clocking the owner
+   uint32_t getCyclesUntilClock() const
+   {
+      if (period == 0)
+      {
+         return std::numeric_limits<uint32_t>::max();
       }
+
+      // The owner is clocked during the machine cycle in which the counter runs out
+      return counter == 0 ? 0 : ((counter - 1) / CPU::kClockCyclesPerMachineCycle) * CPU::kClockCyclesPerMachineCycle;
    }
 
    void setPeriod(uint32_t newPeriod)
@@ -468,9 +519,14 @@ public:
    uint8_t read(uint16_t address) const;
    void write(uint16_t address, uint8_t value);
 
-   void machineCycle()
+   bool advance(uint32_t cycles)
    {
-      timer.machineCycle();
+      return timer.advance(cycles) > 0;
+   }
+
+   uint32_t getCyclesUntilClock() const
+   {
+      return timer.getCyclesUntilClock();
    }
 
    void clock()
@@ -538,9 +594,14 @@ public:
    uint8_t read(uint16_t address) const;
    void write(uint16_t address, uint8_t value);
 
-   void machineCycle()
+   bool advance(uint32_t cycles)
+   {
+      return timer.advance(cycles) > 0;
+   }
+
+   uint32_t getCyclesUntilClock() const
    {
-      timer.machineCycle();
+      return timer.getCyclesUntilClock();
    }
 
    void clock()
@@ -595,9 +656,14 @@ public:
    uint8_t read(uint16_t address) const;
    void write(uint16_t address, uint8_t value);
 
-   void machineCycle()
+   bool advance(uint32_t cycles)
    {
-      timer.machineCycle();
+      return timer.advance(cycles) > 0;
+   }
+
+   uint32_t getCyclesUntilClock() const
+   {
+      return timer.getCyclesUntilClock();
    }
 
    void clock()
@@ -635,16 +701,23 @@ private:
 class FrameSequencer
 {
 public:
+   static const uint32_t kPeriod = CPU::kClockSpeed / 512;
+
    FrameSequencer(SoundController& owningSoundController)
       : timer(*this)
       , owner(owningSoundController)
    {
-      timer.setPeriod(CPU::kClockSpeed / 512);
+      timer.setPeriod(kPeriod);
    }
 
-   void machineCycle()
+   bool advance(uint32_t cycles)
    {
-      timer.machineCycle();
+      return timer.advance(cycles) > 0;
+   }
+
+   uint32_t getCyclesUntilClock() const
+   {
+      return timer.getCyclesUntilClock();
    }
 
    void clock();
@@ -688,12 +761,27 @@ private:
    bool noiseRightEnabled = false;
 };
 
+enum class AudioPolicy : uint8_t
+{
+   Synthesize, // Produce samples
+   Silent // Only keep the state visible through the registers (frame sequencer, length, sweep and envelope) exact, for instances that don't need audio
+};
+
 class SoundController
 {
 public:
-   static const size_t kSampleRate = 44100;
+   static const uint32_t kDefaultSampleRate = 44100;
+   static const uint32_t kMinSampleRate = 8000;
+   static const uint32_t kMaxSampleRate = 96000;
    static const size_t kBufferSize = 4096;
 
+   // Limit for setSampleRateScale()
+   static constexpr double kMaxSampleRateScale = 1.02;
+
+   // Samples are synthesized in bulk every audio frame
+   static const uint32_t kAudioFrameClocks = FrameSequencer::kPeriod;
+   static constexpr size_t kMaxSamplesPerAudioFrame = static_cast<size_t>((kAudioFrameClocks + CPU::kClockCyclesPerMachineCycle) * kMaxSampleRate * kMaxSampleRateScale / CPU::kClockSpeed) + 1;
+
    SoundController();
 
 #if DM_PROJECT_PLAYDATE
@@ -701,21 +789,63 @@ public:
    {
       DM_ASSERT(leftBuffer.size() == rightBuffer.size());
 
-      std::size_t writeOffset = leftAudioRingBuffer.getWriteOffset();
-
-      std::size_t leftNum = leftAudioRingBuffer.pop(leftBuffer, writeOffset);
-      std::size_t rightNum = rightAudioRingBuffer.pop(rightBuffer, writeOffset);
-      DM_ASSERT(leftNum == rightNum);
+      // Samples are pushed to the left buffer first but popped from the right buffer first, so the left buffer never has fewer samples than the right one
+      std::size_t numSamples = rightAudioRingBuffer.pop(rightBuffer);
+      std::size_t leftNum = leftAudioRingBuffer.pop(leftBuffer.first(numSamples));
+      DM_ASSERT(leftNum == numSamples);
 
-      return leftNum;
+      return numSamples;
    }
 #else
+   // Can be called from a different thread than the one emulating
    std::size_t consumeAudio(std::span<AudioSample> buffer)
    {
       return audioRingBuffer.pop(buffer);
    }
 #endif
 
+   // Rate that samples are produced at (e.g. the output device's rate, so it doesn't need to resample them again)
+   // Takes effect at the start of the next audio frame, samples that have already been produced are left as-is
+   void setSampleRate(uint32_t newSampleRate)
+   {
+      DM_ASSERT(newSampleRate >= kMinSampleRate && newSampleRate <= kMaxSampleRate, "Unsupported sample rate: %u", newSampleRate);
+      sampleRate = std::clamp(newSampleRate, kMinSampleRate, kMaxSampleRate);
+   }
+
+   uint32_t getSampleRate() const
+   {
+      return sampleRate;
+   }
+
+   // Nudges the sample rate (e.g. by a fraction of a percent), so a consumer's buffer can be kept from draining or backing up
+   // Takes effect at the start of the next audio frame
+   void setSampleRateScale(double scale)
+   {
+      DM_ASSERT(scale >= 1.0 / kMaxSampleRateScale && scale <= kMaxSampleRateScale);
+      sampleRateScale = std::clamp(scale, 1.0 / kMaxSampleRateScale, kMaxSampleRateScale);
+   }
+
+   double getSampleRateScale() const
+   {
+      return sampleRateScale;
+   }
+
+   void setAudioPolicy(AudioPolicy newAudioPolicy);
+
+   AudioPolicy getAudioPolicy() const
+   {
+      return audioPolicy;
+   }
+
+   // The sink only receives samples while the policy is AudioPolicy::Synthesize
+   // Clearing (or replacing) the sink hands it the samples up to the current cycle first
+   void setAudioSink(AudioSink* newAudioSink);
+
+   AudioSink* getAudioSink() const
+   {
+      return sinkOutput ? &sinkOutput->sink : nullptr;
+   }
+
    void machineCycle();
 
    uint8_t read(uint16_t address) const;
@@ -727,7 +857,17 @@ private:
    uint8_t readNr52() const;
    void writeNr52(uint8_t value);
    void setPowerEnabled(bool newPowerEnabled);
-   void pushSample();
+
+   // Runs all of the cycles that have passed since the last catch up
+   void catchUp();
+   uint32_t getCyclesUntilClock() const;
+
+   // Adds the change in the mixed output (if any) to the blip buffers
+   void updateOutput();
+   // Turns everything added to the blip buffers so far into samples
+   void endAudioFrame();
+   // Hands everything added to the sink's blip buffers so far to the sink
+   void flushAudioSink();
 
    void lengthClock()
    {
@@ -752,6 +892,7 @@ private:
    FrameSequencer frameSequencer;
    Mixer mixer;
    bool powerEnabled = true;
+   AudioPolicy audioPolicy = AudioPolicy::Synthesize;
 
    SquareWaveChannel squareWaveChannel1;
    SquareWaveChannel squareWaveChannel2;
@@ -759,32 +900,67 @@ private:
    NoiseChannel noiseChannel;
 
 #if DM_PROJECT_PLAYDATE
-   RingBuffer<int16_t, kBufferSize> leftAudioRingBuffer;
-   RingBuffer<int16_t, kBufferSize> rightAudioRingBuffer;
+   SPSCRingBuffer<int16_t, kBufferSize> leftAudioRingBuffer;
+   SPSCRingBuffer<int16_t, kBufferSize> rightAudioRingBuffer;
 #else
-   RingBuffer<AudioSample, kBufferSize> audioRingBuffer;
+   SPSCRingBuffer<AudioSample, kBufferSize> audioRingBuffer;
 #endif
 
-   uint8_t cyclesSinceLastSample = 0;
-   uint8_t cyclesForNextSample = CPU::kClockSpeed / kSampleRate;
-   float remainderCycles = 0.0f;
+   BlipBuffer leftBlipBuffer;
+   BlipBuffer rightBlipBuffer;
+   AudioSample output; // The mixed output, as last added to the blip buffers
+   uint32_t audioFrameClocks = 0; // Clocks since the start of the current audio frame
+   uint32_t sampleRate = kDefaultSampleRate;
+   double sampleRateScale = 1.0;
+   double outputRate = kDefaultSampleRate; // The scaled sample rate, as given to the blip buffers
 
-#if DM_WITH_UI
-   struct UIData
+   struct SinkOutput
    {
-      AudioSample sample = {};
-      int8_t square1 = 0;
-      int8_t square2 = 0;
-      int8_t wave = 0;
-      int8_t noise = 0;
+      SinkOutput(AudioSink& audioSink);
+
+      AudioSink& sink;
+      bool withStems = false;
+
+      BlipBuffer leftBlipBuffer;
+      BlipBuffer rightBlipBuffer;
+      AudioSample output;
+
+      std::vector<BlipBuffer> stemBlipBuffers; // Square 1, square 2, wave, noise (if the sink wants stems)
+      std::array<int16_t, 4> stemOutput = {};
    };
 
-   RingBuffer<UIData, kBufferSize> uiRingBuffer;
+   std::unique_ptr<SinkOutput> sinkOutput;
+
+   // The sound controller only runs when something needs it to be up to date, instead of every machine cycle
+   uint32_t pendingCycles = 0;
+   uint32_t cyclesUntilCatchUp = 0;
 
-   std::size_t consumeUIData(std::span<UIData> buffer)
+#if DM_WITH_UI
+public:
+   // Telemetry for plotting is only gathered while enabled (e.g. while the plots are visible)
+   void setUITelemetryEnabled(bool enabled);
+
+private:
+   // Each column holds the range of every signal over a fixed number of clocks, so plots don't need every sample
+   struct UIColumn
    {
-      return uiRingBuffer.pop(buffer);
-   }
+      AudioSample min;
+      AudioSample max;
+      std::array<int8_t, 4> channelMin = {}; // Square 1, square 2, wave, noise
+      std::array<int8_t, 4> channelMax = {};
+   };
+
+   static const uint32_t kUIClocksPerColumn = 2048;
+   static const std::size_t kNumUIColumns = 512; // A quarter of a second
+
+   void advanceUITelemetry(uint32_t cycles);
+   void addToUIColumn(const std::array<int8_t, 4>& channelSamples);
+
+   bool uiTelemetryEnabled = false;
+   uint32_t uiColumnClocks = 0; // Clocks since the start of the current column
+   std::size_t uiColumnIndex = 0; // The current column, the oldest one comes right after it
+   std::array<int8_t, 4> uiChannelOutput = {}; // Each channel's output, as last added to the current column
+   std::array<UIColumn, kNumUIColumns> uiColumns = {};
 #endif // DM_WITH_UI
 };
 
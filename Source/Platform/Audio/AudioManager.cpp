@@ -7,8 +7,12 @@
 
 #include <AL/al.h>
 #include <AL/alc.h>
+#include <AL/alext.h>
 #include <boxer/boxer.h>
 
+#include <algorithm>
+#include <numeric>
+
 namespace
 {
 #if DM_WITH_DEBUG_UTILS
@@ -90,11 +94,26 @@ namespace
          checkAlcError(device, "destroying context");
       }
    }
+
+   // Only OpenAL Soft (ALC_SOFT_device_clock) reports the device's latency
+   LPALCGETINTEGER64VSOFT loadGetInteger64Function(ALCdevice* device)
+   {
+      if (!alcIsExtensionPresent(device, "ALC_SOFT_device_clock"))
+      {
+         return nullptr;
+      }
+
+      return reinterpret_cast<LPALCGETINTEGER64VSOFT>(alcGetProcAddress(device, "alcGetInteger64vSOFT"));
+   }
 }
 
-AudioManager::AudioManager()
+AudioManager::AudioManager(const Config& audioConfig)
    : device(alcOpenDevice(nullptr), deleteDevice)
+   , config(audioConfig)
 {
+   config.numBuffers = std::clamp(config.numBuffers, Config::kMinBuffers, Config::kMaxBuffers);
+   config.bufferSize = std::clamp(config.bufferSize, Config::kMinBufferSize, Config::kMaxBufferSize);
+
    checkAlcError(device.get(), "opening device");
 
    if (!device)
@@ -119,6 +138,25 @@ AudioManager::AudioManager()
    }
    checkAlcError(device.get(), "making audio context current");
 
+   // Produce audio at the device's own rate when possible, so it doesn't need to be resampled again
+   ALCint frequency = 0;
+   alcGetIntegerv(device.get(), ALC_FREQUENCY, 1, &frequency);
+   checkAlcError(device.get(), "querying device frequency");
+   if (frequency >= static_cast<ALCint>(DotMatrix::SoundController::kMinSampleRate) && frequency <= static_cast<ALCint>(DotMatrix::SoundController::kMaxSampleRate))
+   {
+      sampleRate = static_cast<uint32_t>(frequency);
+   }
+
+   ALCint refresh = 0;
+   alcGetIntegerv(device.get(), ALC_REFRESH, 1, &refresh);
+   checkAlcError(device.get(), "querying device refresh rate");
+   if (refresh > 0)
+   {
+      mixPeriod = 1.0 / refresh;
+   }
+
+   getInteger64Function = reinterpret_cast<void (*)()>(loadGetInteger64Function(device.get()));
+
    alGenSources(1, &source);
    checkAlError("generating audio source");
 
@@ -132,14 +170,17 @@ AudioManager::AudioManager()
    alSourcei(source, AL_LOOPING, AL_FALSE);
    checkAlError("disabling source looping");
 
+   buffers.resize(config.numBuffers);
    alGenBuffers(static_cast<ALsizei>(buffers.size()), buffers.data());
    checkAlError("generating buffers");
 
    DotMatrix::AudioSample silenceSample;
    for (ALuint buffer : buffers)
    {
-      alBufferData(buffer, AL_FORMAT_STEREO16, &silenceSample, static_cast<ALsizei>(sizeof(DotMatrix::AudioSample)), static_cast<ALsizei>(DotMatrix::SoundController::kSampleRate));
+      alBufferData(buffer, AL_FORMAT_STEREO16, &silenceSample, static_cast<ALsizei>(sizeof(DotMatrix::AudioSample)), static_cast<ALsizei>(sampleRate));
       checkAlError("setting buffer data");
+
+      queuedBufferSizes.push_back(1);
    }
 
    alSourceQueueBuffers(source, static_cast<ALsizei>(buffers.size()), buffers.data());
@@ -182,7 +223,53 @@ bool AudioManager::canQueue() const
    return numProcessed > 0;
 }
 
-void AudioManager::queue(std::span<DotMatrix::AudioSample> audioData)
+int AudioManager::getNumQueuedBuffers() const
+{
+   if (!isValid())
+   {
+      return 0;
+   }
+
+   ALint numQueued = 0;
+   alGetSourcei(source, AL_BUFFERS_QUEUED, &numQueued);
+   checkAlError("querying number of buffers queued");
+
+   ALint numProcessed = 0;
+   alGetSourcei(source, AL_BUFFERS_PROCESSED, &numProcessed);
+   checkAlError("querying number of buffers processed");
+
+   return numQueued - numProcessed;
+}
+
+uint32_t AudioManager::getNumQueuedSamples() const
+{
+   if (!isValid())
+   {
+      return 0;
+   }
+
+   ALint state = 0;
+   alGetSourcei(source, AL_SOURCE_STATE, &state);
+   checkAlError("getting source state");
+
+   if (state != AL_PLAYING)
+   {
+      // Processed buffers stay at the front of the queue until they are unqueued
+      std::size_t numPending = static_cast<std::size_t>(std::max(getNumQueuedBuffers(), 0));
+      numPending = std::min(numPending, queuedBufferSizes.size());
+      return std::accumulate(queuedBufferSizes.end() - numPending, queuedBufferSizes.end(), 0u);
+   }
+
+   // The offset is relative to the start of the first buffer still in the queue (processed or not)
+   ALint sampleOffset = 0;
+   alGetSourcei(source, AL_SAMPLE_OFFSET, &sampleOffset);
+   checkAlError("getting source sample offset");
+
+   uint32_t totalQueued = std::accumulate(queuedBufferSizes.begin(), queuedBufferSizes.end(), 0u);
+   return totalQueued - std::min(totalQueued, static_cast<uint32_t>(std::max(sampleOffset, 0)));
+}
+
+void AudioManager::queue(std::span<DotMatrix::AudioSample> audioData, bool resuming)
 {
    DM_ASSERT(!audioData.empty());
    DM_ASSERT(canQueue());
@@ -190,12 +277,14 @@ void AudioManager::queue(std::span<DotMatrix::AudioSample> audioData)
    ALuint buffer = 0;
    alSourceUnqueueBuffers(source, 1, &buffer);
    checkAlError("unqueueing buffer");
+   queuedBufferSizes.pop_front();
 
-   alBufferData(buffer, AL_FORMAT_STEREO16, audioData.data(), static_cast<ALsizei>(audioData.size_bytes()), static_cast<ALsizei>(DotMatrix::SoundController::kSampleRate));
+   alBufferData(buffer, AL_FORMAT_STEREO16, audioData.data(), static_cast<ALsizei>(audioData.size_bytes()), static_cast<ALsizei>(sampleRate));
    checkAlError("setting buffer data");
 
    alSourceQueueBuffers(source, 1, &buffer);
    checkAlError("queueing buffer");
+   queuedBufferSizes.push_back(static_cast<uint32_t>(audioData.size()));
 
    ALint state = 0;
    alGetSourcei(source, AL_SOURCE_STATE, &state);
@@ -203,9 +292,18 @@ void AudioManager::queue(std::span<DotMatrix::AudioSample> audioData)
 
    if (state != AL_PLAYING)
    {
+      // The source stops once it has played everything, so after the initial silence this means audio wasn't queued in time
+      if (started && !resuming)
+      {
+         ++numUnderruns;
+         DM_LOG_WARNING("Audio underrun (" << numUnderruns << " total)");
+      }
+
       alSourcePlay(source);
       checkAlError("playing source");
    }
+
+   started = true;
 }
 
 void AudioManager::setPitch(float pitch)
@@ -218,3 +316,43 @@ void AudioManager::setPitch(float pitch)
       currentPitch = pitch;
    }
 }
+
+double AudioManager::getDeviceLatency() const
+{
+   if (!isValid() || !getInteger64Function)
+   {
+      return 0.0;
+   }
+
+   ALCint64SOFT latency = 0;
+   reinterpret_cast<LPALCGETINTEGER64VSOFT>(getInteger64Function)(device.get(), ALC_DEVICE_LATENCY_SOFT, 1, &latency);
+   checkAlcError(device.get(), "querying device latency");
+
+   return static_cast<double>(latency) / 1'000'000'000.0;
+}
+
+double AudioManager::getTimeUntilCanQueue() const
+{
+   if (!isValid() || canQueue())
+   {
+      return 0.0;
+   }
+
+   ALint state = 0;
+   alGetSourcei(source, AL_SOURCE_STATE, &state);
+   checkAlError("getting source state");
+
+   // The buffer is only marked as processed by the first mix after it finishes, so never wait for less than one mix
+   if (state != AL_PLAYING || currentPitch <= 0.0f || queuedBufferSizes.empty())
+   {
+      return mixPeriod;
+   }
+
+   // Nothing has been processed, so the offset is into the buffer at the front of the queue
+   ALint sampleOffset = 0;
+   alGetSourcei(source, AL_SAMPLE_OFFSET, &sampleOffset);
+   checkAlError("getting source sample offset");
+
+   uint32_t remainingSamples = queuedBufferSizes.front() - std::min(queuedBufferSizes.front(), static_cast<uint32_t>(std::max(sampleOffset, 0)));
+   return std::max(remainingSamples / (static_cast<double>(sampleRate) * currentPitch), mixPeriod);
+}
@@ -6,11 +6,12 @@
 
 #include "GameBoy/SoundController.h"
 
-#include <array>
 #include <cstdint>
+#include <deque>
 #include <functional>
 #include <memory>
 #include <span>
+#include <vector>
 
 struct ALCcontext;
 struct ALCdevice;
@@ -19,7 +20,20 @@ typedef unsigned int ALuint;
 class AudioManager
 {
 public:
-   AudioManager();
+   struct Config
+   {
+      static constexpr uint32_t kMinBuffers = 2;
+      static constexpr uint32_t kMaxBuffers = 8;
+      static constexpr uint32_t kMinBufferSize = 64;
+      static constexpr uint32_t kMaxBufferSize = 1024;
+
+      uint32_t numBuffers = 3;
+      uint32_t bufferSize = 256; // Samples per buffer (about 6 ms at 44.1 kHz)
+
+      bool operator==(const Config& other) const = default;
+   };
+
+   AudioManager(const Config& audioConfig);
    ~AudioManager();
 
    bool isValid() const
@@ -28,14 +42,50 @@ public:
    }
 
    bool canQueue() const;
-   void queue(std::span<DotMatrix::AudioSample> audioData);
+   // Number of buffers waiting to be (or being) played
+   int getNumQueuedBuffers() const;
+   // Samples that have been queued but not yet played
+   uint32_t getNumQueuedSamples() const;
+   // resuming should be set when the audio being queued is the first since the producer deliberately stopped (e.g. while fast forwarding or paused),
+   // since the source running dry in the meantime isn't an underrun
+   void queue(std::span<DotMatrix::AudioSample> audioData, bool resuming = false);
 
    void setPitch(float pitch);
 
+   uint32_t getSampleRate() const
+   {
+      return sampleRate;
+   }
+
+   const Config& getConfig() const
+   {
+      return config;
+   }
+
+   // Number of times the source ran out of audio and stopped playing
+   uint32_t getNumUnderruns() const
+   {
+      return numUnderruns;
+   }
+
+   // Time between a sample leaving the source and reaching the speakers, as reported by the device (zero if unknown)
+   double getDeviceLatency() const;
+
+   // Estimated time (in seconds) until a buffer is processed and can be queued again, based on how far the device has played through the queue
+   // Zero if one can be queued now
+   double getTimeUntilCanQueue() const;
+
 private:
    std::unique_ptr<ALCdevice, std::function<void(ALCdevice*)>> device;
    std::unique_ptr<ALCcontext, std::function<void(ALCcontext*)>> context;
    ALuint source = 0;
-   std::array<ALuint, 3> buffers = {};
+   Config config;
+   std::vector<ALuint> buffers;
+   std::deque<uint32_t> queuedBufferSizes; // Mirrors the source's queue, oldest first
    float currentPitch = -1.0f;
+   uint32_t sampleRate = DotMatrix::SoundController::kDefaultSampleRate;
+   double mixPeriod = 0.01; // How often the device mixes (which is when buffers are marked as processed), OpenAL Soft defaults to 10 ms
+   uint32_t numUnderruns = 0;
+   bool started = false;
+   void (*getInteger64Function)() = nullptr; // alcGetInteger64vSOFT if ALC_SOFT_device_clock is supported (alext.h isn't included here, so it's stored type-erased)
 };
@@ -0,0 +1,139 @@
+#include "Core/Assert.h"
+#include "Core/Log.h"
+
+#include "Platform/Audio/AudioRecorder.h"
+
+#include <algorithm>
+#include <string>
+
+namespace
+{
+   // About two seconds of audio, the queue only allocates more if the writer falls further behind than that
+   const std::size_t kInitialQueueCapacity = 1024;
+
+   const std::array<const char*, 4> kStemNames = { "square1", "square2", "wave", "noise" };
+
+   std::filesystem::path getStemPath(const std::filesystem::path& mixPath, const char* stemName)
+   {
+      std::filesystem::path stemPath = mixPath;
+      stemPath.replace_filename(mixPath.stem().string() + "_" + stemName + mixPath.extension().string());
+      return stemPath;
+   }
+}
+
+AudioRecorder::AudioRecorder(const std::filesystem::path& path, uint32_t recordSampleRate, bool recordStems)
+   : mixPath(path)
+   , sampleRate(recordSampleRate)
+   , withStems(recordStems)
+   , chunkQueue(kInitialQueueCapacity)
+{
+   valid = mixWriter.open(mixPath, 2, sampleRate);
+
+   if (withStems)
+   {
+      for (std::size_t i = 0; i < kNumStems; ++i)
+      {
+         valid = valid && stemWriters[i].open(getStemPath(mixPath, kStemNames[i]), 1, sampleRate);
+      }
+   }
+
+   if (!valid)
+   {
+      DM_LOG_WARNING("Unable to open audio recording: " << mixPath.string());
+      return;
+   }
+
+   writerThread = std::thread([this]
+   {
+      writerThreadMain();
+   });
+}
+
+AudioRecorder::~AudioRecorder()
+{
+   if (writerThread.joinable())
+   {
+      // Nothing is added once the recorder has been detached, so an empty chunk marks the end of the recording (everything queued before it is still written)
+      chunkQueue.enqueue(Chunk{});
+      writerThread.join();
+   }
+
+   mixWriter.close();
+   for (WavWriter& stemWriter : stemWriters)
+   {
+      stemWriter.close();
+   }
+}
+
+void AudioRecorder::writeSamples(std::span<const DotMatrix::AudioSample> samples, std::span<const DotMatrix::StemSample> stems)
+{
+   DM_ASSERT(samples.size() <= DotMatrix::SoundController::kMaxSamplesPerAudioFrame);
+   DM_ASSERT(stems.empty() || stems.size() == samples.size());
+
+   if (!valid || samples.empty())
+   {
+      return;
+   }
+
+   Chunk chunk;
+   chunk.numSamples = std::min(samples.size(), chunk.samples.size());
+   std::copy_n(samples.begin(), chunk.numSamples, chunk.samples.begin());
+
+   chunk.hasStems = !stems.empty();
+   if (chunk.hasStems)
+   {
+      std::copy_n(stems.begin(), chunk.numSamples, chunk.stems.begin());
+   }
+
+   // Never blocks, at worst it allocates another block for the queue
+   chunkQueue.enqueue(std::move(chunk));
+}
+
+void AudioRecorder::writerThreadMain()
+{
+   Chunk chunk;
+   while (true)
+   {
+      chunkQueue.wait_dequeue(chunk);
+      if (chunk.numSamples == 0)
+      {
+         break;
+      }
+
+      writeChunk(chunk);
+   }
+}
+
+void AudioRecorder::writeChunk(const Chunk& chunk)
+{
+   std::array<int16_t, DotMatrix::SoundController::kMaxSamplesPerAudioFrame * 2> interleaved;
+   for (std::size_t i = 0; i < chunk.numSamples; ++i)
+   {
+      interleaved[i * 2] = chunk.samples[i].left;
+      interleaved[i * 2 + 1] = chunk.samples[i].right;
+   }
+
+   bool wrote = mixWriter.write(std::span<const int16_t>(interleaved.data(), chunk.numSamples * 2));
+
+   if (withStems && chunk.hasStems)
+   {
+      std::array<std::array<int16_t, DotMatrix::SoundController::kMaxSamplesPerAudioFrame>, kNumStems> stemSamples;
+      for (std::size_t i = 0; i < chunk.numSamples; ++i)
+      {
+         stemSamples[0][i] = chunk.stems[i].square1;
+         stemSamples[1][i] = chunk.stems[i].square2;
+         stemSamples[2][i] = chunk.stems[i].wave;
+         stemSamples[3][i] = chunk.stems[i].noise;
+      }
+
+      for (std::size_t stem = 0; stem < kNumStems; ++stem)
+      {
+         wrote = stemWriters[stem].write(std::span<const int16_t>(stemSamples[stem].data(), chunk.numSamples)) && wrote;
+      }
+   }
+
+   if (wrote)
+   {
+      numSamplesWritten.fetch_add(chunk.numSamples);
+   }
+}
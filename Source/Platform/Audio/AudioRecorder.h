@@ -0,0 +1,81 @@
+#pragma once
+
+#include "GameBoy/SoundController.h"
+
+#include "Platform/Audio/WavWriter.h"
+
+#include <readerwriterqueue.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <thread>
+
+// Records a sound controller's audio to .wav files: the mixed output in stereo, and optionally each channel in mono (square1 / square2 / wave / noise, next to the mixed file)
+// Samples are handed off to a writer thread, so recording never waits on the disk
+// Attach it with SoundController::setAudioSink(), and detach it before destroying it
+class AudioRecorder final : public DotMatrix::AudioSink
+{
+public:
+   AudioRecorder(const std::filesystem::path& path, uint32_t recordSampleRate, bool recordStems);
+   ~AudioRecorder();
+
+   // False if any of the files couldn't be opened
+   bool isValid() const
+   {
+      return valid;
+   }
+
+   const std::filesystem::path& getPath() const
+   {
+      return mixPath;
+   }
+
+   uint32_t getSampleRate() const override
+   {
+      return sampleRate;
+   }
+
+   bool wantsStems() const override
+   {
+      return withStems;
+   }
+
+   // Called on the emulation thread
+   void writeSamples(std::span<const DotMatrix::AudioSample> samples, std::span<const DotMatrix::StemSample> stems) override;
+
+   // Number of samples (per channel) written to disk so far
+   uint64_t getNumSamplesWritten() const
+   {
+      return numSamplesWritten.load();
+   }
+
+private:
+   static const std::size_t kNumStems = 4;
+
+   // One audio frame's worth of samples (an empty chunk tells the writer to stop)
+   struct Chunk
+   {
+      std::array<DotMatrix::AudioSample, DotMatrix::SoundController::kMaxSamplesPerAudioFrame> samples;
+      std::array<DotMatrix::StemSample, DotMatrix::SoundController::kMaxSamplesPerAudioFrame> stems;
+      std::size_t numSamples = 0;
+      bool hasStems = false;
+   };
+
+   void writerThreadMain();
+   void writeChunk(const Chunk& chunk);
+
+   std::filesystem::path mixPath;
+   uint32_t sampleRate = 0;
+   bool withStems = false;
+   bool valid = false;
+
+   WavWriter mixWriter;
+   std::array<WavWriter, kNumStems> stemWriters;
+
+   moodycamel::BlockingReaderWriterQueue<Chunk> chunkQueue;
+   std::thread writerThread;
+   std::atomic<uint64_t> numSamplesWritten = { 0 };
+};
@@ -0,0 +1,142 @@
+#include "Core/Assert.h"
+
+#include "Platform/Audio/WavWriter.h"
+
+#include <limits>
+
+namespace
+{
+   // RIFF header, fmt chunk, and data chunk header
+   const uint32_t kHeaderSize = 44;
+   const uint32_t kMaxDataSize = std::numeric_limits<uint32_t>::max() - (kHeaderSize - 8);
+
+   void appendLittleEndian(std::vector<uint8_t>& data, uint16_t value)
+   {
+      data.push_back(static_cast<uint8_t>(value));
+      data.push_back(static_cast<uint8_t>(value >> 8));
+   }
+
+   void appendLittleEndian(std::vector<uint8_t>& data, uint32_t value)
+   {
+      data.push_back(static_cast<uint8_t>(value));
+      data.push_back(static_cast<uint8_t>(value >> 8));
+      data.push_back(static_cast<uint8_t>(value >> 16));
+      data.push_back(static_cast<uint8_t>(value >> 24));
+   }
+
+   void appendTag(std::vector<uint8_t>& data, const char* tag)
+   {
+      data.insert(data.end(), tag, tag + 4);
+   }
+
+   std::vector<uint8_t> createHeader(uint16_t numChannels, uint32_t sampleRate, uint32_t dataSize)
+   {
+      static const uint16_t kPcmFormat = 1;
+      static const uint16_t kBitsPerSample = 16;
+
+      uint16_t blockAlign = numChannels * (kBitsPerSample / 8);
+
+      std::vector<uint8_t> header;
+      header.reserve(kHeaderSize);
+
+      appendTag(header, "RIFF");
+      appendLittleEndian(header, (kHeaderSize - 8) + dataSize);
+      appendTag(header, "WAVE");
+
+      appendTag(header, "fmt ");
+      appendLittleEndian(header, uint32_t{ 16 });
+      appendLittleEndian(header, kPcmFormat);
+      appendLittleEndian(header, numChannels);
+      appendLittleEndian(header, sampleRate);
+      appendLittleEndian(header, sampleRate * blockAlign);
+      appendLittleEndian(header, blockAlign);
+      appendLittleEndian(header, kBitsPerSample);
+
+      appendTag(header, "data");
+      appendLittleEndian(header, dataSize);
+
+      DM_ASSERT(header.size() == kHeaderSize);
+      return header;
+   }
+}
+
+WavWriter::~WavWriter()
+{
+   close();
+}
+
+bool WavWriter::open(const std::filesystem::path& path, uint16_t numChannels, uint32_t sampleRate)
+{
+   DM_ASSERT(numChannels > 0 && sampleRate > 0);
+
+   close();
+
+   stream.open(path, std::ios::binary | std::ios::trunc);
+   if (!stream)
+   {
+      return false;
+   }
+
+   channels = numChannels;
+   rate = sampleRate;
+   dataSize = 0;
+
+   // Sizes are left empty until the file is closed
+   std::vector<uint8_t> header = createHeader(channels, rate, dataSize);
+   stream.write(reinterpret_cast<const char*>(header.data()), header.size());
+
+   if (!stream)
+   {
+      stream.close();
+      return false;
+   }
+
+   return true;
+}
+
+void WavWriter::close()
+{
+   if (!stream.is_open())
+   {
+      return;
+   }
+
+   std::vector<uint8_t> header = createHeader(channels, rate, dataSize);
+
+   stream.seekp(0);
+   stream.write(reinterpret_cast<const char*>(header.data()), header.size());
+   stream.close();
+}
+
+bool WavWriter::write(std::span<const int16_t> samples)
+{
+   DM_ASSERT(channels > 0 && samples.size() % channels == 0);
+
+   if (!stream.is_open())
+   {
+      return false;
+   }
+
+   std::size_t size = samples.size() * sizeof(int16_t);
+   if (size > kMaxDataSize - dataSize)
+   {
+      return false;
+   }
+
+   // Always little endian, regardless of the host
+   bytes.clear();
+   bytes.reserve(size);
+   for (int16_t sample : samples)
+   {
+      appendLittleEndian(bytes, static_cast<uint16_t>(sample));
+   }
+
+   stream.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+   if (!stream)
+   {
+      return false;
+   }
+
+   dataSize += static_cast<uint32_t>(size);
+   return true;
+}
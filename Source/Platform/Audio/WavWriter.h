@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <vector>
+
+// Streams 16-bit PCM samples to a .wav file
+// The header is written up front and its sizes are filled in when the file is closed
+class WavWriter
+{
+public:
+   WavWriter() = default;
+   WavWriter(const WavWriter& other) = delete;
+   WavWriter(WavWriter&& other) = default;
+   ~WavWriter();
+
+   WavWriter& operator=(const WavWriter& other) = delete;
+   WavWriter& operator=(WavWriter&& other) = default;
+
+   bool open(const std::filesystem::path& path, uint16_t numChannels, uint32_t sampleRate);
+   void close();
+
+   bool isOpen() const
+   {
+      return stream.is_open();
+   }
+
+   // samples are interleaved, and should contain whole frames (one sample per channel)
+   // Returns false if the samples could not be written (e.g. the file reached the format's 4 GB limit)
+   bool write(std::span<const int16_t> samples);
+
+private:
+   std::ofstream stream;
+   std::vector<uint8_t> bytes;
+   uint16_t channels = 0;
+   uint32_t rate = 0;
+   uint32_t dataSize = 0;
+};
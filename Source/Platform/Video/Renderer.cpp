@@ -5,6 +5,11 @@
 #include "Platform/Video/ShaderProgram.h"
 #include "Platform/Video/Texture.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <utility>
+
 namespace
 {
 
@@ -40,6 +45,33 @@ const char *kFragShaderSource = R"GLSL(
    }
 )GLSL";
 
+// Maps the 2-bit shades to colors, rendering one fragment per Game Boy pixel
+const char *kShadeVertShaderSource = R"GLSL(
+   #version 150 core
+
+   in vec2 aPosition;
+
+   void main()
+   {
+      gl_Position = vec4(aPosition, 0.0, 1.0);
+   }
+)GLSL";
+
+const char *kShadeFragShaderSource = R"GLSL(
+   #version 150 core
+
+   uniform usampler2D uShades;
+   uniform mat4 uPalette; // One color per column
+
+   out vec4 color;
+
+   void main()
+   {
+      uint shade = texelFetch(uShades, ivec2(gl_FragCoord.xy), 0).r;
+      color = uPalette[shade & 3u];
+   }
+)GLSL";
+
 const std::array<float, 8> kVertices = { -1.0f, -1.0f,
                                           1.0f, -1.0f,
                                          -1.0f,  1.0f,
@@ -49,6 +81,7 @@ const std::array<unsigned int, 6> kIndices = { 0, 1, 2,
                                                1, 3, 2 };
 
 const GLenum kTextureUnit = 0;
+const GLenum kShadeTextureUnit = 1;
 
 using Mat4 = std::array<float, 16>;
 
@@ -66,52 +99,100 @@ Mat4 ortho(float left, float right, float bottom, float top)
    return result;
 }
 
-} // namespace
-
-Renderer::Renderer(int width, int height)
-   : model(Mesh(kVertices.data(), static_cast<unsigned int>(kVertices.size()), kIndices.data(), static_cast<unsigned int>(kIndices.size()), 2), ShaderProgram())
-   , texture(GL_TEXTURE_2D)
+void linkProgram(ShaderProgram& program, const char* vertShaderSource, const char* fragShaderSource)
 {
-   // Back face culling
-   glEnable(GL_CULL_FACE);
-   glCullFace(GL_BACK);
-
-   // Shaders
    std::shared_ptr<Shader> vertShader = std::make_shared<Shader>(GL_VERTEX_SHADER);
    std::shared_ptr<Shader> fragShader = std::make_shared<Shader>(GL_FRAGMENT_SHADER);
 
-   if (!vertShader->compile(kVertShaderSource))
+   if (!vertShader->compile(vertShaderSource))
    {
       DM_ASSERT(false, "Unable to compile vertex shader");
    }
-   if (!fragShader->compile(kFragShaderSource))
+   if (!fragShader->compile(fragShaderSource))
    {
       DM_ASSERT(false, "Unable to compile fragment shader");
    }
 
-   model.getProgram().attach(vertShader);
-   model.getProgram().attach(fragShader);
-   if (!model.getProgram().link())
+   program.attach(vertShader);
+   program.attach(fragShader);
+   if (!program.link())
    {
       DM_ASSERT(false, "Unable to link shader program");
    }
+}
+
+Mesh createQuadMesh()
+{
+   return Mesh(kVertices.data(), static_cast<unsigned int>(kVertices.size()), kIndices.data(), static_cast<unsigned int>(kIndices.size()), 2);
+}
+
+} // namespace
+
+Renderer::Renderer(int width, int height, std::size_t numUploadBuffers)
+   : model(createQuadMesh(), ShaderProgram())
+   , shadeModel(createQuadMesh(), ShaderProgram())
+   , shadeTexture(GL_TEXTURE_2D)
+   , screenTexture(GL_TEXTURE_2D)
+   , uploadBuffers(std::max<std::size_t>(numUploadBuffers, 1), 0)
+{
+   // Back face culling
+   glEnable(GL_CULL_FACE);
+   glCullFace(GL_BACK);
 
-   // Texture
+   // Shaders
+   linkProgram(model.getProgram(), kVertShaderSource, kFragShaderSource);
+   linkProgram(shadeModel.getProgram(), kShadeVertShaderSource, kShadeFragShaderSource);
+
+   // Shade texture (integer textures can't be filtered)
+   glActiveTexture(GL_TEXTURE0 + kShadeTextureUnit);
+   shadeTexture.bind();
+
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+   glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, DotMatrix::kScreenWidth, DotMatrix::kScreenHeight, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+
+   // Screen texture
    glActiveTexture(GL_TEXTURE0 + kTextureUnit);
-   texture.bind();
+   screenTexture.bind();
 
    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
 
-   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, DotMatrix::kScreenWidth, DotMatrix::kScreenHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, DotMatrix::kScreenWidth, DotMatrix::kScreenHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+
+   glGenFramebuffers(1, &screenFramebuffer);
+   glBindFramebuffer(GL_FRAMEBUFFER, screenFramebuffer);
+   glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, screenTexture.id(), 0);
+   DM_ASSERT(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE, "Screen framebuffer is incomplete");
+   glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+   // Pixel buffers, so texture uploads are DMA'd from driver-owned memory instead of being copied synchronously from ours
+   glGenBuffers(static_cast<GLsizei>(uploadBuffers.size()), uploadBuffers.data());
+   for (GLuint uploadBuffer : uploadBuffers)
+   {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffer);
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, DotMatrix::kScreenWidth * DotMatrix::kScreenHeight, nullptr, GL_STREAM_DRAW);
+   }
+   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 
    model.getProgram().setUniformValue("uTexture", kTextureUnit);
+   shadeModel.getProgram().setUniformValue("uShades", kShadeTextureUnit);
+   setPalette(DotMatrix::kFramebufferColors);
 
    onFramebufferSizeChanged(width, height);
 }
 
+Renderer::~Renderer()
+{
+   glDeleteBuffers(static_cast<GLsizei>(uploadBuffers.size()), uploadBuffers.data());
+   glDeleteFramebuffers(1, &screenFramebuffer);
+}
+
 void Renderer::onFramebufferSizeChanged(int width, int height)
 {
    DM_ASSERT(width > 0 && height > 0, "Invalid framebuffer size: %d x %d", width, height);
@@ -120,6 +201,9 @@ void Renderer::onFramebufferSizeChanged(int width, int height)
    height = std::max(1, height);
    glViewport(0, 0, width, height);
 
+   framebufferWidth = width;
+   framebufferHeight = height;
+
    static const float kInvGameBoyAspectRatio = static_cast<float>(DotMatrix::kScreenHeight) / DotMatrix::kScreenWidth;
    float framebufferAspectRatio = static_cast<float>(width) / height;
    float aspectRatio = framebufferAspectRatio * kInvGameBoyAspectRatio;
@@ -129,14 +213,142 @@ void Renderer::onFramebufferSizeChanged(int width, int height)
    model.getProgram().setUniformValue("uProj", proj);
 }
 
-void Renderer::draw(const DotMatrix::PixelArray& pixels)
+void Renderer::setPalette(const std::array<DotMatrix::Pixel, 4>& colors)
 {
-   DM_ASSERT(pixels.size() == DotMatrix::kScreenWidth * DotMatrix::kScreenHeight);
+   mat4 newPalette = {};
+   float* values = RAW_VALUE(newPalette);
+   for (std::size_t i = 0; i < colors.size(); ++i)
+   {
+      values[i * 4 + 0] = colors[i].r / 255.0f;
+      values[i * 4 + 1] = colors[i].g / 255.0f;
+      values[i * 4 + 2] = colors[i].b / 255.0f;
+      values[i * 4 + 3] = 1.0f;
+   }
+
+   if (newPalette != palette)
+   {
+      palette = newPalette;
+      shadeModel.getProgram().setUniformValue("uPalette", palette);
+      screenDirty = true;
+   }
+}
+
+void Renderer::draw(const DotMatrix::Framebuffer& framebuffer, const DotMatrix::LineMask& dirtyLines)
+{
+   uploadShades(framebuffer, dirtyLines);
+
+   if (screenDirty)
+   {
+      shadeScreen();
+   }
 
    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
    glClear(GL_COLOR_BUFFER_BIT);
 
-   glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, DotMatrix::kScreenWidth, DotMatrix::kScreenHeight, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+   glActiveTexture(GL_TEXTURE0 + kTextureUnit);
+   screenTexture.bind();
 
    model.draw();
 }
+
+void Renderer::uploadShades(const DotMatrix::Framebuffer& framebuffer, const DotMatrix::LineMask& newDirtyLines)
+{
+   DotMatrix::LineMask dirtyLines = newDirtyLines;
+   if (uploadFailed)
+   {
+      // The previous upload never made it to the texture, so the rows it had can't be trusted anymore
+      dirtyLines.set();
+   }
+
+   if (dirtyLines.none())
+   {
+      return;
+   }
+
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+   // Cycle through the pixel buffers so we never write into one the GPU may still be reading from
+   // Orphaning it as well lets the driver hand back fresh storage instead of synchronizing
+   GLuint uploadBuffer = uploadBuffers[uploadBufferIndex];
+   uploadBufferIndex = (uploadBufferIndex + 1) % uploadBuffers.size();
+
+   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffer);
+   glBufferData(GL_PIXEL_UNPACK_BUFFER, framebuffer.size(), nullptr, GL_STREAM_DRAW);
+
+   uint8_t* mappedShades = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, framebuffer.size(), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+   if (!mappedShades)
+   {
+      DM_ASSERT(false, "Unable to map pixel buffer");
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      uploadFailed = true;
+      return;
+   }
+
+   // Runs of rows that changed, at the same offsets they have in the framebuffer
+   std::array<std::pair<std::size_t, std::size_t>, (DotMatrix::kScreenHeight + 1) / 2> runs;
+   std::size_t numRuns = 0;
+   std::size_t uploadedBytes = 0;
+
+   std::size_t y = 0;
+   while (y < DotMatrix::kScreenHeight)
+   {
+      if (!dirtyLines.test(y))
+      {
+         ++y;
+         continue;
+      }
+
+      std::size_t firstLine = y;
+      while (y < DotMatrix::kScreenHeight && dirtyLines.test(y))
+      {
+         ++y;
+      }
+      std::size_t numLines = y - firstLine;
+
+      std::size_t offset = firstLine * DotMatrix::kScreenWidth;
+      std::size_t size = numLines * DotMatrix::kScreenWidth;
+      std::memcpy(mappedShades + offset, &framebuffer[offset], size);
+
+      runs[numRuns++] = { firstLine, numLines };
+      uploadedBytes += size;
+   }
+
+   if (!glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+   {
+      // The buffer contents were lost (e.g. a display mode change), so upload every line next frame
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      uploadFailed = true;
+      return;
+   }
+
+   uploadFailed = false;
+
+   glActiveTexture(GL_TEXTURE0 + kShadeTextureUnit);
+   shadeTexture.bind();
+   glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+   for (std::size_t i = 0; i < numRuns; ++i)
+   {
+      std::size_t offset = runs[i].first * DotMatrix::kScreenWidth;
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, static_cast<GLint>(runs[i].first), DotMatrix::kScreenWidth, static_cast<GLsizei>(runs[i].second), GL_RED_INTEGER, GL_UNSIGNED_BYTE, reinterpret_cast<const void*>(offset));
+   }
+
+   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+   screenDirty = true;
+
+   uploadStats.uploadTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+   uploadStats.uploadedBytes = uploadedBytes;
+}
+
+void Renderer::shadeScreen()
+{
+   glBindFramebuffer(GL_FRAMEBUFFER, screenFramebuffer);
+   glViewport(0, 0, DotMatrix::kScreenWidth, DotMatrix::kScreenHeight);
+
+   shadeModel.draw();
+
+   glBindFramebuffer(GL_FRAMEBUFFER, 0);
+   glViewport(0, 0, framebufferWidth, framebufferHeight);
+
+   screenDirty = false;
+}
@@ -5,20 +5,55 @@
 #include "Platform/Video/Model.h"
 #include "Platform/Video/Texture.h"
 
+#include <vector>
+
 class Renderer
 {
 public:
-   Renderer(int width, int height);
+   static constexpr std::size_t kDefaultNumUploadBuffers = 3;
+
+   struct UploadStats
+   {
+      // CPU time spent staging and submitting the last upload (the transfer itself completes asynchronously)
+      double uploadTime = 0.0;
+      std::size_t uploadedBytes = 0;
+   };
+
+   // numUploadBuffers is the number of pixel buffers cycled through, i.e. how many uploads can be in flight at once
+   Renderer(int width, int height, std::size_t numUploadBuffers = kDefaultNumUploadBuffers);
+   ~Renderer();
 
    void onFramebufferSizeChanged(int width, int height);
-   void draw(const DotMatrix::PixelArray& pixels);
+   void setPalette(const std::array<DotMatrix::Pixel, 4>& colors);
+   void draw(const DotMatrix::Framebuffer& framebuffer, const DotMatrix::LineMask& dirtyLines);
 
+   // Shaded screen contents (the raw shade texture isn't displayable on its own)
    GLuint getTextureId() const
    {
-      return texture.id();
+      return screenTexture.id();
+   }
+
+   const UploadStats& getUploadStats() const
+   {
+      return uploadStats;
    }
 
 private:
+   void uploadShades(const DotMatrix::Framebuffer& framebuffer, const DotMatrix::LineMask& dirtyLines);
+   void shadeScreen();
+
    Model model;
-   Texture texture;
+   Model shadeModel;
+   Texture shadeTexture;
+   Texture screenTexture;
+   GLuint screenFramebuffer = 0;
+   std::vector<GLuint> uploadBuffers;
+   std::size_t uploadBufferIndex = 0;
+   UploadStats uploadStats;
+   mat4 palette = {};
+
+   int framebufferWidth = 1;
+   int framebufferHeight = 1;
+   bool screenDirty = true;
+   bool uploadFailed = false;
 };
@@ -51,6 +51,7 @@ void Uniform::commit()
       case GL_SAMPLER_1D_SHADOW:
       case GL_SAMPLER_2D_SHADOW:
       case GL_SAMPLER_CUBE_SHADOW:
+      case GL_UNSIGNED_INT_SAMPLER_2D:
          glUniform1i(location, pendingData.intVal);
          break;
       case GL_FLOAT:
@@ -93,7 +94,8 @@ void Uniform::setValue(int value)
           type == GL_SAMPLER_CUBE ||
           type == GL_SAMPLER_1D_SHADOW ||
           type == GL_SAMPLER_2D_SHADOW ||
-          type == GL_SAMPLER_CUBE_SHADOW);
+          type == GL_SAMPLER_CUBE_SHADOW ||
+          type == GL_UNSIGNED_INT_SAMPLER_2D);
    dirty = activeData.intVal != value;
    pendingData.intVal = value;
 }
@@ -64,6 +64,8 @@ namespace
    {
       std::unique_ptr<DotMatrix::GameBoy> gameBoy;
       LCDBitmap* bitmap = nullptr;
+      uint32_t bitmapFrameCounter = 0;
+      bool bitmapValid = false;
       float lastTime = 0.0f;
       bool wroteToRamLastFrame = false;
 
@@ -301,7 +303,7 @@ namespace
       return joypad;
    }
 
-   void framebufferToBitmap(PlaydateAPI* pd, const DotMatrix::Framebuffer& framebuffer, LCDBitmap* bitmap)
+   void framebufferToBitmap(PlaydateAPI* pd, const DotMatrix::Framebuffer& framebuffer, LCDBitmap* bitmap, const DotMatrix::LineMask& lines)
    {
       static int width = 0;
       static int height = 0;
@@ -327,6 +329,11 @@ namespace
 #if DM_PLAYDATE_SCALE
       for (int y = 0; y < static_cast<int>(DotMatrix::kScreenHeight); ++y)
       {
+         if (!lines.test(y))
+         {
+            continue;
+         }
+
          for (int x = 0; x < static_cast<int>(DotMatrix::kScreenWidth); x += 4)
          {
             int topByteOffset = (x / 4) + 2 * y * rowbytes;
@@ -349,23 +356,31 @@ namespace
          }
       }
 #else
-      int byteOffset = 0;
-      int bitOffset = 7;
-      for (int i = 0; i < width * height; ++i)
+      for (int y = 0; y < height; ++y)
       {
-         uint8_t& byte = data[byteOffset];
-         if (bitOffset == 7)
+         if (!lines.test(y))
          {
-            byte = 0;
+            continue;
          }
 
-         byte |= ((framebuffer[i] > 1 ? 0 : 1) << bitOffset);
-
-         --bitOffset;
-         if (bitOffset < 0)
+         int byteOffset = y * rowbytes;
+         int bitOffset = 7;
+         for (int i = y * width; i < (y + 1) * width; ++i)
          {
-            ++byteOffset;
-            bitOffset = 7;
+            uint8_t& byte = data[byteOffset];
+            if (bitOffset == 7)
+            {
+               byte = 0;
+            }
+
+            byte |= ((framebuffer[i] > 1 ? 0 : 1) << bitOffset);
+
+            --bitOffset;
+            if (bitOffset < 0)
+            {
+               ++byteOffset;
+               bitOffset = 7;
+            }
          }
       }
 #endif
@@ -383,7 +398,23 @@ namespace
       constexpr int kY = (LCD_ROWS - DotMatrix::kScreenHeight) / 2;
 #endif
 
-      framebufferToBitmap(pd, State::gameBoy->getLCDController().getFramebuffer(), State::bitmap);
+      DotMatrix::LCDController& lcdController = State::gameBoy->getLCDController();
+      if (lcdController.acquireLatestFrame() || !State::bitmapValid)
+      {
+         uint32_t frameCounter = lcdController.getFrameCounter();
+
+         // Only convert the lines that changed, unless frames were skipped since the bitmap was last updated
+         DotMatrix::LineMask lines = lcdController.getDirtyLines();
+         if (!State::bitmapValid || frameCounter != State::bitmapFrameCounter + 1)
+         {
+            lines.set();
+         }
+
+         framebufferToBitmap(pd, lcdController.getFramebuffer(), State::bitmap, lines);
+
+         State::bitmapFrameCounter = frameCounter;
+         State::bitmapValid = true;
+      }
 
       if (pd->system->isCrankDocked())
       {
@@ -467,6 +498,7 @@ namespace
 #endif
 
       State::bitmap = pd->graphics->newBitmap(static_cast<int>(DotMatrix::kScreenWidth * kBitmapScale), static_cast<int>(DotMatrix::kScreenHeight * kBitmapScale), kColorBlack);
+      State::bitmapValid = false;
 
       pd->system->resetElapsedTime();
 
@@ -2,6 +2,7 @@
 
 #include "GameBoy/Cartridge.h"
 #include "GameBoy/CPU.h"
+#include "GameBoy/FramebufferSink.h"
 #include "GameBoy/GameBoy.h"
 #include "GameBoy/LCDController.h"
 #include "GameBoy/SoundController.h"
@@ -10,6 +11,7 @@
 
 #include <array>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <memory>
 #include <string>
@@ -20,23 +22,8 @@ namespace
    static const double kClockCyclesPerFrame = 70224.0;
    static const double kFrameRate = DotMatrix::CPU::kClockSpeed / kClockCyclesPerFrame;
 
-   struct Pixel
-   {
-      uint8_t b;
-      uint8_t g;
-      uint8_t r;
-      uint8_t x;
-
-      Pixel(uint8_t red = 0x00, uint8_t green = 0x00, uint8_t blue = 0x00)
-         : x(0x00)
-         , r(red)
-         , g(green)
-         , b(blue)
-      {
-      }
-   };
-
-   using PixelArray = std::array<Pixel, DotMatrix::kScreenWidth * DotMatrix::kScreenHeight>;
+   // Green / blue (trying to approximate original Game Boy screen colors)
+   static const DotMatrix::Palette kPalette = { 0xACCD4A, 0x7BAC6A, 0x206A62, 0x082952 };
 
    namespace Callbacks
    {
@@ -50,48 +37,50 @@ namespace
    namespace State
    {
       std::unique_ptr<DotMatrix::GameBoy> gameBoy;
-      std::unique_ptr<PixelArray> pixels;
+      std::unique_ptr<DotMatrix::PaletteFramebufferSink> framebufferSink;
       std::vector<DotMatrix::AudioSample> audioBuffer(DotMatrix::SoundController::kBufferSize);
 
       uint32_t frameCounter = 0;
       double frameTime = 0.0;
+      bool canDupeFrames = false;
+      uint32_t sampleRate = DotMatrix::SoundController::kDefaultSampleRate;
    }
 
-   void frameTimeCallback(retro_usec_t usec)
+   // Lets the frontend pick the rate that audio is produced at, so it doesn't need to resample it again (the first value is the default)
+   const char* kSampleRateVariableKey = "dotmatrix_sample_rate";
+   retro_variable variables[] =
    {
-      State::frameTime = usec / 1000000.0;
-   }
+      { kSampleRateVariableKey, "Audio sample rate (Hz); 44100|48000|32000|96000" },
+      { nullptr, nullptr }
+   };
 
-   void framebufferToPixels(const DotMatrix::Framebuffer& framebuffer, PixelArray& pixels)
+   uint32_t readSampleRateVariable()
    {
-      // Green / blue (trying to approximate original Game Boy screen colors)
-      static const std::array<Pixel, 4> kColors =
+      retro_variable variable = { kSampleRateVariableKey, nullptr };
+      if (Callbacks::environment && Callbacks::environment(RETRO_ENVIRONMENT_GET_VARIABLE, &variable) && variable.value)
       {
-         Pixel(0xAC, 0xCD, 0x4A),
-         Pixel(0x7B, 0xAC, 0x6A),
-         Pixel(0x20, 0x6A, 0x62),
-         Pixel(0x08, 0x29, 0x52)
-      };
+         unsigned long value = std::strtoul(variable.value, nullptr, 10);
+         if (value >= DotMatrix::SoundController::kMinSampleRate && value <= DotMatrix::SoundController::kMaxSampleRate)
+         {
+            return static_cast<uint32_t>(value);
+         }
+      }
 
-      DM_ASSERT(pixels.size() == framebuffer.size());
+      return DotMatrix::SoundController::kDefaultSampleRate;
+   }
 
-      for (std::size_t i = 0; i < pixels.size(); ++i)
-      {
-         DM_ASSERT(framebuffer[i] < kColors.size());
-         pixels[i] = kColors[framebuffer[i]];
-      }
+   void frameTimeCallback(retro_usec_t usec)
+   {
+      State::frameTime = usec / 1000000.0;
    }
 
-   void updatePixelsAndRefreshVideo()
+   void refreshVideo(bool frameChanged)
    {
-      if (State::gameBoy && State::pixels)
+      if (State::gameBoy && State::framebufferSink && Callbacks::videoRefresh)
       {
-         framebufferToPixels(State::gameBoy->getLCDController().getFramebuffer(), *State::pixels);
-
-         if (Callbacks::videoRefresh)
-         {
-            Callbacks::videoRefresh(State::pixels->data(), DotMatrix::kScreenWidth, DotMatrix::kScreenHeight, DotMatrix::kScreenWidth * sizeof(Pixel));
-         }
+         // If nothing changed, let the frontend reuse the last frame instead of copying it again
+         const void* data = (frameChanged || !State::canDupeFrames) ? State::framebufferSink->getPixels() : nullptr;
+         Callbacks::videoRefresh(data, DotMatrix::kScreenWidth, DotMatrix::kScreenHeight, State::framebufferSink->getPitch());
       }
    }
 }
@@ -99,6 +88,11 @@ namespace
 void retro_set_environment(retro_environment_t callback)
 {
    Callbacks::environment = callback;
+
+   if (Callbacks::environment)
+   {
+      Callbacks::environment(RETRO_ENVIRONMENT_SET_VARIABLES, variables);
+   }
 }
 
 void retro_set_video_refresh(retro_video_refresh_t callback)
@@ -127,7 +121,7 @@ void retro_set_input_state(retro_input_state_t callback)
 
 void retro_init(void)
 {
-   State::pixels = std::make_unique<PixelArray>();
+   State::framebufferSink = std::make_unique<DotMatrix::PaletteFramebufferSink>(DotMatrix::PixelFormat::XRGB8888, kPalette);
 
    State::frameCounter = 0;
    State::frameTime = 0.0;
@@ -135,7 +129,7 @@ void retro_init(void)
 
 void retro_deinit(void)
 {
-   State::pixels = nullptr;
+   State::framebufferSink = nullptr;
 
    State::frameCounter = 0;
    State::frameTime = 0.0;
@@ -169,7 +163,7 @@ void retro_get_system_av_info(struct retro_system_av_info* info)
       info->geometry.aspect_ratio = static_cast<float>(DotMatrix::kScreenWidth) / DotMatrix::kScreenHeight;
 
       info->timing.fps = kFrameRate;
-      info->timing.sample_rate = DotMatrix::SoundController::kSampleRate;
+      info->timing.sample_rate = State::sampleRate;
    }
 }
 
@@ -206,6 +200,21 @@ void retro_run(void)
       }
       State::gameBoy->setJoypadState(joypad);
 
+      bool variablesUpdated = false;
+      if (Callbacks::environment && Callbacks::environment(RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE, &variablesUpdated) && variablesUpdated)
+      {
+         uint32_t newSampleRate = readSampleRateVariable();
+         if (newSampleRate != State::sampleRate)
+         {
+            State::sampleRate = newSampleRate;
+            State::gameBoy->getSoundController().setSampleRate(State::sampleRate);
+
+            retro_system_av_info avInfo;
+            retro_get_system_av_info(&avInfo);
+            Callbacks::environment(RETRO_ENVIRONMENT_SET_SYSTEM_AV_INFO, &avInfo);
+         }
+      }
+
       State::gameBoy->tick(State::frameTime);
 
       std::size_t numSamples = State::gameBoy->getSoundController().consumeAudio(State::audioBuffer);
@@ -214,12 +223,13 @@ void retro_run(void)
          Callbacks::audioSampleBatch(&State::audioBuffer[0].left, numSamples);
       }
 
-      uint32_t newFrameCounter = State::gameBoy->getLCDController().getFrameCounter();
-      if (State::frameCounter != newFrameCounter)
+      if (State::framebufferSink->acquireLatestFrame())
       {
-         updatePixelsAndRefreshVideo();
+         // The dirty lines only describe the difference from the previous frame, so they can't be trusted if frames were skipped
+         uint32_t newFrameCounter = State::framebufferSink->getFrameCounter();
+         refreshVideo(newFrameCounter != State::frameCounter + 1 || State::framebufferSink->getDirtyLines().any());
+         State::frameCounter = newFrameCounter;
       }
-      State::frameCounter = newFrameCounter;
    }
 }
 
@@ -259,6 +269,9 @@ bool retro_load_game(const struct retro_game_info* game)
       callbackInfo.callback = &frameTimeCallback;
       callbackInfo.reference = 1000000.0 / kFrameRate;
       timeCallbackRegistered = Callbacks::environment(RETRO_ENVIRONMENT_SET_FRAME_TIME_CALLBACK, &callbackInfo);
+
+      bool canDupe = false;
+      State::canDupeFrames = Callbacks::environment(RETRO_ENVIRONMENT_GET_CAN_DUPE, &canDupe) && canDupe;
    }
 
    if (!pixelFormatSupported || !timeCallbackRegistered)
@@ -274,10 +287,14 @@ bool retro_load_game(const struct retro_game_info* game)
       std::string error;
       if (std::unique_ptr<DotMatrix::Cartridge> cartridge = DotMatrix::Cartridge::fromData(std::move(data), error))
       {
+         State::sampleRate = readSampleRateVariable();
+
          State::gameBoy = std::make_unique<DotMatrix::GameBoy>();
          State::gameBoy->setCartridge(std::move(cartridge));
+         State::gameBoy->getSoundController().setSampleRate(State::sampleRate);
+         State::gameBoy->getLCDController().setFramebufferSink(State::framebufferSink.get());
 
-         updatePixelsAndRefreshVideo();
+         refreshVideo(true);
 
          return true;
       }
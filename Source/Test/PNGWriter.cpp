@@ -0,0 +1,138 @@
+#include "Test/PNGWriter.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+
+namespace PNGWriter
+{
+   namespace
+   {
+      std::array<uint32_t, 256> createCrcTable()
+      {
+         std::array<uint32_t, 256> table = {};
+
+         for (uint32_t i = 0; i < 256; ++i)
+         {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; ++bit)
+            {
+               value = (value & 1) ? (0xEDB88320 ^ (value >> 1)) : (value >> 1);
+            }
+            table[i] = value;
+         }
+
+         return table;
+      }
+
+      uint32_t crc32(const uint8_t* data, std::size_t size)
+      {
+         static const std::array<uint32_t, 256> kCrcTable = createCrcTable();
+
+         uint32_t crc = 0xFFFFFFFF;
+         for (std::size_t i = 0; i < size; ++i)
+         {
+            crc = kCrcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+         }
+
+         return crc ^ 0xFFFFFFFF;
+      }
+
+      uint32_t adler32(const std::vector<uint8_t>& data)
+      {
+         static const uint32_t kModulus = 65521;
+
+         uint32_t a = 1;
+         uint32_t b = 0;
+         for (uint8_t value : data)
+         {
+            a = (a + value) % kModulus;
+            b = (b + a) % kModulus;
+         }
+
+         return (b << 16) | a;
+      }
+
+      void appendBigEndian(std::vector<uint8_t>& data, uint32_t value)
+      {
+         data.push_back(static_cast<uint8_t>(value >> 24));
+         data.push_back(static_cast<uint8_t>(value >> 16));
+         data.push_back(static_cast<uint8_t>(value >> 8));
+         data.push_back(static_cast<uint8_t>(value));
+      }
+
+      void appendChunk(std::vector<uint8_t>& png, const char* type, const std::vector<uint8_t>& chunkData)
+      {
+         appendBigEndian(png, static_cast<uint32_t>(chunkData.size()));
+
+         std::size_t typeOffset = png.size();
+         png.insert(png.end(), type, type + 4);
+         png.insert(png.end(), chunkData.begin(), chunkData.end());
+
+         // The CRC covers the chunk type and data, but not the length
+         appendBigEndian(png, crc32(png.data() + typeOffset, png.size() - typeOffset));
+      }
+
+      // Wraps the data in a zlib stream made of stored (uncompressed) deflate blocks
+      std::vector<uint8_t> deflateStored(const std::vector<uint8_t>& data)
+      {
+         static const std::size_t kMaxBlockSize = 0xFFFF;
+
+         std::vector<uint8_t> stream = { 0x78, 0x01 };
+
+         std::size_t offset = 0;
+         do
+         {
+            std::size_t blockSize = std::min(data.size() - offset, kMaxBlockSize);
+            bool finalBlock = offset + blockSize == data.size();
+
+            stream.push_back(finalBlock ? 0x01 : 0x00);
+            stream.push_back(static_cast<uint8_t>(blockSize));
+            stream.push_back(static_cast<uint8_t>(blockSize >> 8));
+            stream.push_back(static_cast<uint8_t>(~blockSize));
+            stream.push_back(static_cast<uint8_t>(~blockSize >> 8));
+            stream.insert(stream.end(), data.begin() + offset, data.begin() + offset + blockSize);
+
+            offset += blockSize;
+         } while (offset < data.size());
+
+         appendBigEndian(stream, adler32(data));
+
+         return stream;
+      }
+   }
+
+   std::vector<uint8_t> encodeGrayscale(const uint8_t* pixels, uint32_t width, uint32_t height)
+   {
+      static const std::array<uint8_t, 8> kSignature = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+      static const uint8_t kBitDepth = 8;
+      static const uint8_t kGrayscaleColorType = 0;
+
+      std::vector<uint8_t> header;
+      appendBigEndian(header, width);
+      appendBigEndian(header, height);
+      header.push_back(kBitDepth);
+      header.push_back(kGrayscaleColorType);
+      header.push_back(0); // Compression method
+      header.push_back(0); // Filter method
+      header.push_back(0); // Interlace method
+
+      // Each row is preceded by its filter type (0, no filtering)
+      std::vector<uint8_t> rows;
+      rows.reserve((static_cast<std::size_t>(width) + 1) * height);
+      for (uint32_t y = 0; y < height; ++y)
+      {
+         const uint8_t* row = pixels + static_cast<std::size_t>(y) * width;
+
+         rows.push_back(0);
+         rows.insert(rows.end(), row, row + width);
+      }
+
+      std::vector<uint8_t> png(kSignature.begin(), kSignature.end());
+      appendChunk(png, "IHDR", header);
+      appendChunk(png, "IDAT", deflateStored(rows));
+      appendChunk(png, "IEND", {});
+
+      return png;
+   }
+}
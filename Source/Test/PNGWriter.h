@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace PNGWriter
+{
+   // Encodes 8-bit grayscale pixels (row-major, one byte per pixel) as an uncompressed PNG
+   std::vector<uint8_t> encodeGrayscale(const uint8_t* pixels, uint32_t width, uint32_t height);
+}
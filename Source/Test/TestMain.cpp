@@ -6,16 +6,28 @@
 #undef private
 #undef _ALLOW_KEYWORD_MACROS
 
+#include "Core/Assert.h"
+#include "Core/PerformanceCounters.h"
+
+#include "GameBoy/ObservationSink.h"
+
+#include "Platform/Audio/AudioRecorder.h"
+
+#include "Test/PNGWriter.h"
+
 #include <PlatformUtils/IOUtils.h>
 #include <readerwriterqueue.h>
 
 #include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <filesystem>
 #include <future>
+#include <iomanip>
 #include <memory>
 #include <sstream>
 #include <thread>
+#include <unordered_map>
 
 namespace
 {
@@ -67,24 +79,124 @@ namespace
       Result result = Result::Error;
    };
 
-   struct TestWorkerData
+   const double kFrameTime = 70224.0 / DotMatrix::CPU::kClockSpeed;
+
+   // Calls work(i) for every i in [0, numItems) spread across worker threads, printing the message returned for each item as it completes
+   template<typename Function>
+   void runOnWorkers(std::size_t numItems, Function work)
    {
-      TestWorkerData(std::vector<TestResult>& results, moodycamel::ReaderWriterQueue<std::string>& queue, std::size_t first, std::size_t last, float time)
-         : testResults(results)
-         , messageQueue(queue)
-         , firstIndex(first)
-         , lastIndex(last)
-         , testTime(time)
+      std::size_t numWorkers = std::min(numItems, static_cast<std::size_t>(std::max(1U, std::thread::hardware_concurrency())));
+      std::size_t numItemsPerWorker = numItems / numWorkers;
+      std::size_t numLeftoverItems = numItems % numWorkers;
+
+      std::vector<std::future<void>> futures;
+      std::vector<std::unique_ptr<moodycamel::ReaderWriterQueue<std::string>>> messageQueues; // One per worker, since each queue only supports a single producer
+
+      std::size_t firstIndex = 0;
+      for (std::size_t i = 0; i < numWorkers; ++i)
       {
+         std::size_t lastIndex = firstIndex + numItemsPerWorker - 1;
+         if (numLeftoverItems > 0)
+         {
+            ++lastIndex;
+            --numLeftoverItems;
+         }
+
+         messageQueues.push_back(std::make_unique<moodycamel::ReaderWriterQueue<std::string>>());
+         futures.push_back(std::async(std::launch::async, [&work, &messageQueue = *messageQueues.back(), firstIndex, lastIndex]()
+         {
+            for (std::size_t index = firstIndex; index <= lastIndex; ++index)
+            {
+               messageQueue.enqueue(work(index));
+            }
+         }));
+
+         firstIndex = lastIndex + 1;
       }
 
-      std::vector<TestResult>& testResults;
-      moodycamel::ReaderWriterQueue<std::string>& messageQueue;
+      auto allWorkersDone = [&futures]()
+      {
+         for (const std::future<void>& future : futures)
+         {
+            if (future.wait_for(std::chrono::milliseconds(0)) != std::future_status::ready)
+            {
+               return false;
+            }
+         }
 
-      std::size_t firstIndex;
-      std::size_t lastIndex;
-      float testTime;
-   };
+         return true;
+      };
+
+      auto processMessages = [&messageQueues]()
+      {
+         std::string message;
+         for (std::unique_ptr<moodycamel::ReaderWriterQueue<std::string>>& messageQueue : messageQueues)
+         {
+            while (messageQueue->try_dequeue(message))
+            {
+               std::printf("%s\n", message.c_str());
+            }
+         }
+      };
+
+      bool done = false;
+      while (!done)
+      {
+         done = allWorkersDone();
+         processMessages();
+
+         if (!done)
+         {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+         }
+      }
+   }
+
+   std::vector<std::filesystem::path> getCartPathsRecursive(const std::filesystem::path& path, bool isBlargg)
+   {
+      std::vector<std::filesystem::path> filePaths = getAllFilePathsRecursive(path);
+
+      // Only try to run .gb files
+      filePaths.erase(std::remove_if(filePaths.begin(), filePaths.end(), [](const std::filesystem::path& filePath)
+      {
+         return filePath.extension() != ".gb";
+      }), filePaths.end());
+
+      if (isBlargg)
+      {
+         // Only run individual tests
+         filePaths.erase(std::remove_if(filePaths.begin(), filePaths.end(), [](const std::filesystem::path& filePath)
+         {
+            if (filePath.has_parent_path())
+            {
+               std::filesystem::path parentPath = filePath.parent_path();
+               std::filesystem::path individualPath = parentPath / "individual";
+               std::filesystem::path romSinglesPath = parentPath / "rom_singles";
+
+               if (std::filesystem::is_directory(individualPath) || std::filesystem::is_directory(romSinglesPath))
+               {
+                  return true;
+               }
+            }
+
+            return false;
+         }), filePaths.end());
+      }
+
+      std::sort(filePaths.begin(), filePaths.end());
+
+      return filePaths;
+   }
+
+   std::unique_ptr<DotMatrix::Cartridge> loadCart(const std::filesystem::path& cartPath, std::string& error)
+   {
+      if (std::optional<std::vector<uint8_t>> cartData = IOUtils::readBinaryFile(cartPath))
+      {
+         return DotMatrix::Cartridge::fromData(std::move(*cartData), error);
+      }
+
+      return nullptr;
+   }
 
    template<std::size_t size>
    bool valuesMatch(const std::vector<uint8_t>& values, const std::array<uint8_t, size>& testValues)
@@ -106,12 +218,13 @@ namespace
       return true;
    }
 
-   Result runTestCart(std::unique_ptr<DotMatrix::Cartridge> cart, float time, bool isMooneye)
+   Result runTestCart(std::unique_ptr<DotMatrix::Cartridge> cart, float time, bool isMooneye, DotMatrix::AudioPolicy audioPolicy)
    {
       static const std::array<uint8_t, 6> kMooneyeSuccessValues = { 3, 5, 8, 13, 21, 34 };
       static const std::array<uint8_t, 6> kMooneyeFailureValues = { 0x42, 0x42, 0x42, 0x42, 0x42, 0x42 };
 
       std::unique_ptr<DotMatrix::GameBoy> gameBoy = std::make_unique<DotMatrix::GameBoy>();
+      gameBoy->getSoundController().setAudioPolicy(audioPolicy);
       gameBoy->setCartridge(std::move(cart));
 
       std::vector<uint8_t> serialValues;
@@ -139,21 +252,44 @@ namespace
       return success ? Result::Pass : Result::Fail;
    }
 
-   void runTestCartRange(TestWorkerData data)
+   void runTestCartsInPath(std::filesystem::path path, std::filesystem::path resultPath, float time, bool isBlargg)
    {
-      for (std::size_t i = data.firstIndex; i <= data.lastIndex; ++i)
+      std::vector<std::filesystem::path> filePaths = getCartPathsRecursive(path, isBlargg);
+      std::size_t numTests = filePaths.size();
+
+      if (numTests == 0)
       {
-         TestResult& result = data.testResults[i];
+         std::printf("No tests found\n");
+         return;
+      }
+
+      std::vector<TestResult> testResults(numTests);
+      for (std::size_t i = 0; i < numTests; ++i)
+      {
+         testResults[i].cartPath = std::move(filePaths[i]);
+      }
+
+      runOnWorkers(numTests, [&testResults, time](std::size_t index)
+      {
+         TestResult& result = testResults[index];
 
          std::string error;
-         if (std::optional<std::vector<uint8_t>> cartData = IOUtils::readBinaryFile(result.cartPath))
+         if (std::unique_ptr<DotMatrix::Cartridge> cartridge = loadCart(result.cartPath, error))
          {
-            if (std::unique_ptr<DotMatrix::Cartridge> cartridge = DotMatrix::Cartridge::fromData(std::move(*cartData), error))
-            {
-               static const std::string kMooneye = "mooneye";
+            static const std::string kMooneye = "mooneye";
 
-               bool isMooneye = result.cartPath.generic_string().find(kMooneye) != std::string::npos;
-               result.result = runTestCart(std::move(cartridge), data.testTime, isMooneye);
+            bool isMooneye = result.cartPath.generic_string().find(kMooneye) != std::string::npos;
+            result.result = runTestCart(std::move(cartridge), time, isMooneye, DotMatrix::AudioPolicy::Synthesize);
+
+            // Silent audio has to keep every register the carts can observe exact, so it needs to reach the same result
+            if (std::unique_ptr<DotMatrix::Cartridge> silentCartridge = loadCart(result.cartPath, error))
+            {
+               Result silentResult = runTestCart(std::move(silentCartridge), time, isMooneye, DotMatrix::AudioPolicy::Silent);
+               if (silentResult != result.result)
+               {
+                  result.result = Result::Fail;
+                  error = "silent audio gave a different result";
+               }
             }
          }
 
@@ -162,120 +298,543 @@ namespace
          {
             message += " (" + error + ")";
          }
-         data.messageQueue.enqueue(std::move(message));
+         return message;
+      });
+
+      std::stringstream ss;
+      for (const TestResult& result : testResults)
+      {
+         std::filesystem::path relativePath = result.cartPath.lexically_relative(path);
+         ss << '"' << relativePath.generic_string() << '"' << ',' << getResultName(result.result) << '\n';
       }
+
+      IOUtils::writeTextFile(resultPath, ss.str());
    }
 
-   void runTestCartsInPath(std::filesystem::path path, std::filesystem::path resultPath, float time, bool isBlargg)
+   struct ScreenshotResult
    {
-      std::vector<std::filesystem::path> filePaths = getAllFilePathsRecursive(path);
+      std::filesystem::path cartPath;
+      std::optional<uint64_t> hash;
+      std::optional<uint64_t> expectedHash;
+      bool renderModesMatch = true;
+   };
 
-      // Only try to run .gb files
-      filePaths.erase(std::remove_if(filePaths.begin(), filePaths.end(), [](const std::filesystem::path& filePath)
+   // 64-bit FNV-1a
+   uint64_t hashFramebuffer(const DotMatrix::Framebuffer& framebuffer)
+   {
+      uint64_t hash = 0xCBF29CE484222325;
+      for (uint8_t shade : framebuffer)
       {
-         return filePath.extension() != ".gb";
-      }), filePaths.end());
+         hash = (hash ^ shade) * 0x00000100000001B3;
+      }
 
-      if (isBlargg)
+      return hash;
+   }
+
+   std::string formatHash(uint64_t hash)
+   {
+      std::stringstream ss;
+      ss << std::hex << std::setw(16) << std::setfill('0') << hash;
+      return ss.str();
+   }
+
+   // Every way of rendering a screenshot needs to produce the same frame as the default (rendering inline while emulating)
+   enum class RenderMode
+   {
+      Inline,
+      Parallel,
+      Packed
+   };
+
+   const char* getRenderModeName(RenderMode mode)
+   {
+      switch (mode)
       {
-         // Only run individual tests
-         filePaths.erase(std::remove_if(filePaths.begin(), filePaths.end(), [](const std::filesystem::path& filePath)
+      case RenderMode::Inline:
+         return "inline";
+      case RenderMode::Parallel:
+         return "parallel";
+      case RenderMode::Packed:
+         return "packed";
+      default:
+         return "invalid";
+      }
+   }
+
+   DotMatrix::Framebuffer captureScreenshot(std::unique_ptr<DotMatrix::Cartridge> cart, uint32_t numFrames, RenderMode mode)
+   {
+      std::unique_ptr<DotMatrix::GameBoy> gameBoy = std::make_unique<DotMatrix::GameBoy>();
+      gameBoy->getSoundController().setAudioPolicy(DotMatrix::AudioPolicy::Silent); // Nothing listens to the audio
+      gameBoy->setCartridge(std::move(cart));
+
+      DotMatrix::LCDController& lcdController = gameBoy->getLCDController();
+      lcdController.setParallelRenderingEnabled(mode == RenderMode::Parallel);
+      if (mode == RenderMode::Packed)
+      {
+         lcdController.setFramebufferFormat(DotMatrix::FramebufferFormat::Packed);
+      }
+
+      for (uint32_t frame = 0; frame < numFrames; ++frame)
+      {
+         gameBoy->tick(kFrameTime);
+      }
+
+      // Stopping the worker renders everything it has been handed, so the latest frame is the same one the inline renderer would have
+      lcdController.setParallelRenderingEnabled(false);
+
+      lcdController.acquireLatestFrame();
+      if (lcdController.getFramebufferFormat() == DotMatrix::FramebufferFormat::Packed)
+      {
+         DotMatrix::Framebuffer framebuffer;
+         DotMatrix::unpackFramebuffer(lcdController.getPackedFramebuffer(), framebuffer);
+         return framebuffer;
+      }
+
+      return lcdController.getFramebuffer();
+   }
+
+   bool writeScreenshot(const std::filesystem::path& path, const DotMatrix::Framebuffer& framebuffer)
+   {
+      static const std::array<uint8_t, 4> kShadeValues = { 0xFF, 0xAA, 0x55, 0x00 };
+
+      DotMatrix::Framebuffer grayscale;
+      std::transform(framebuffer.begin(), framebuffer.end(), grayscale.begin(), [](uint8_t shade)
+      {
+         return kShadeValues[shade & 0x03];
+      });
+
+      std::error_code errorCode;
+      std::filesystem::create_directories(path.parent_path(), errorCode);
+
+      return IOUtils::writeBinaryFile(path, PNGWriter::encodeGrayscale(grayscale.data(), DotMatrix::kScreenWidth, DotMatrix::kScreenHeight));
+   }
+
+   // Each line of a screenshot result file is formatted as "relative/cart/path.gb",hash
+   std::unordered_map<std::string, uint64_t> readScreenshotHashes(const std::filesystem::path& resultPath)
+   {
+      std::unordered_map<std::string, uint64_t> hashes;
+
+      if (std::optional<std::string> text = IOUtils::readTextFile(resultPath))
+      {
+         std::stringstream ss(*text);
+         std::string line;
+         while (std::getline(ss, line))
          {
-            if (filePath.has_parent_path())
+            std::size_t separator = line.rfind(',');
+            if (separator == std::string::npos || separator < 2 || line.front() != '"' || line[separator - 1] != '"')
             {
-               std::filesystem::path parentPath = filePath.parent_path();
-               std::filesystem::path individualPath = parentPath / "individual";
-               std::filesystem::path romSinglesPath = parentPath / "rom_singles";
+               continue;
+            }
 
-               if (std::filesystem::is_directory(individualPath) || std::filesystem::is_directory(romSinglesPath))
+            std::stringstream hashStream(line.substr(separator + 1));
+            uint64_t hash = 0;
+            if (hashStream >> std::hex >> hash)
+            {
+               hashes.emplace(line.substr(1, separator - 2), hash);
+            }
+         }
+      }
+
+      return hashes;
+   }
+
+   // Compares the final frame of each cart against the hashes in the result file, saving a PNG of every frame that doesn't match (or has nothing to match against)
+   // The result file is then rewritten with the new hashes, so accepting a change is a matter of committing it
+   bool runScreenshotCartsInPath(std::filesystem::path path, std::filesystem::path resultPath, std::filesystem::path screenshotPath, uint32_t numFrames, bool isBlargg)
+   {
+      std::vector<std::filesystem::path> filePaths = getCartPathsRecursive(path, isBlargg);
+      std::size_t numCarts = filePaths.size();
+
+      if (numCarts == 0)
+      {
+         std::printf("No carts found\n");
+         return false;
+      }
+
+      std::unordered_map<std::string, uint64_t> expectedHashes = readScreenshotHashes(resultPath);
+
+      std::vector<ScreenshotResult> screenshotResults(numCarts);
+      for (std::size_t i = 0; i < numCarts; ++i)
+      {
+         ScreenshotResult& result = screenshotResults[i];
+         result.cartPath = std::move(filePaths[i]);
+
+         auto location = expectedHashes.find(result.cartPath.lexically_relative(path).generic_string());
+         if (location != expectedHashes.end())
+         {
+            result.expectedHash = location->second;
+         }
+      }
+
+      runOnWorkers(numCarts, [&screenshotResults, &path, &screenshotPath, numFrames](std::size_t index)
+      {
+         ScreenshotResult& result = screenshotResults[index];
+         std::string message = result.cartPath.generic_string() + ": ";
+
+         std::string error;
+         if (std::unique_ptr<DotMatrix::Cartridge> cartridge = loadCart(result.cartPath, error))
+         {
+            DotMatrix::Framebuffer framebuffer = captureScreenshot(std::move(cartridge), numFrames, RenderMode::Inline);
+            result.hash = hashFramebuffer(framebuffer);
+
+            // The other render modes only need to agree with the inline one
+            std::string renderModeMismatches;
+            for (RenderMode mode : { RenderMode::Parallel, RenderMode::Packed })
+            {
+               std::string modeError;
+               std::unique_ptr<DotMatrix::Cartridge> modeCartridge = loadCart(result.cartPath, modeError);
+               uint64_t modeHash = modeCartridge ? hashFramebuffer(captureScreenshot(std::move(modeCartridge), numFrames, mode)) : 0;
+
+               if (modeHash != *result.hash)
                {
-                  return true;
+                  result.renderModesMatch = false;
+                  renderModeMismatches += std::string(", ") + getRenderModeName(mode) + " rendering differs (got " + formatHash(modeHash) + ")";
                }
             }
 
-            return false;
-         }), filePaths.end());
+            if (result.hash == result.expectedHash)
+            {
+               message += "match";
+            }
+            else
+            {
+               std::filesystem::path imagePath = screenshotPath / result.cartPath.lexically_relative(path);
+               imagePath.replace_extension(".png");
+               bool wroteImage = writeScreenshot(imagePath, framebuffer);
+
+               message += result.expectedHash ? "mismatch (expected " + formatHash(*result.expectedHash) + ", got " + formatHash(*result.hash) + ")" : "new";
+               message += wroteImage ? " -> " + imagePath.generic_string() : " (unable to write " + imagePath.generic_string() + ")";
+            }
+
+            message += renderModeMismatches;
+         }
+         else
+         {
+            message += "error";
+            if (!error.empty())
+            {
+               message += " (" + error + ")";
+            }
+         }
+
+         return message;
+      });
+
+      std::size_t numMismatches = 0;
+      std::stringstream ss;
+      for (const ScreenshotResult& result : screenshotResults)
+      {
+         if (result.hash != result.expectedHash || !result.renderModesMatch)
+         {
+            ++numMismatches;
+         }
+
+         std::filesystem::path relativePath = result.cartPath.lexically_relative(path);
+         ss << '"' << relativePath.generic_string() << '"' << ',' << (result.hash ? formatHash(*result.hash) : "error") << '\n';
       }
 
-      std::sort(filePaths.begin(), filePaths.end());
-      std::size_t numTests = filePaths.size();
+      IOUtils::writeTextFile(resultPath, ss.str());
 
-      if (numTests == 0)
+      std::printf("%zu of %zu screenshots match\n", numCarts - numMismatches, numCarts);
+      return numMismatches == 0;
+   }
+
+   // Enough history to check every stacked observation frame
+   const std::size_t kMaxObservedFrames = 4;
+
+   // Feeds the same lines to several observation sinks, and keeps the most recent frames from the LCD controller to check them against
+   class ObservationChecker final : public DotMatrix::FramebufferSink
+   {
+   public:
+      ObservationChecker(DotMatrix::LCDController& lcdController, const std::vector<DotMatrix::ObservationConfig>& configs)
+         : lcd(lcdController)
       {
-         std::printf("No tests found\n");
-         return;
+         for (const DotMatrix::ObservationConfig& config : configs)
+         {
+            DM_ASSERT(config.numStackedFrames <= kMaxObservedFrames);
+
+            std::string error;
+            sinks.push_back(DotMatrix::ObservationSink::create(config, error));
+            DM_ASSERT(sinks.back(), "%s", error.c_str());
+            buffers.emplace_back((sinks.back()->getObservationSize() + sizeof(float) - 1) / sizeof(float));
+            sinks.back()->setBuffer(buffers.back().data());
+         }
       }
 
-      std::vector<TestResult> testResults(numTests);
-      for (std::size_t i = 0; i < numTests; ++i)
+      void writeLine(uint8_t line, const uint8_t* shades) override
       {
-         testResults[i].cartPath = std::move(filePaths[i]);
+         for (std::unique_ptr<DotMatrix::ObservationSink>& sink : sinks)
+         {
+            sink->writeLine(line, shades);
+         }
       }
 
-      std::size_t numWorkers = std::min(numTests, static_cast<std::size_t>(std::max(1U, std::thread::hardware_concurrency())));
-      std::size_t numTestsPerWorker = numTests / numWorkers;
-      std::size_t numLeftoverTests = numTests % numWorkers;
+      void onFrameCompleted(const DotMatrix::LineMask& dirtyLines) override
+      {
+         for (std::unique_ptr<DotMatrix::ObservationSink>& sink : sinks)
+         {
+            sink->onFrameCompleted(dirtyLines);
+         }
 
-      std::vector<std::future<void>> futures;
-      moodycamel::ReaderWriterQueue<std::string> messageQueue;
+         // The frame was published just before the sink was notified
+         lcd.acquireLatestFrame();
+         history[numFramesCompleted % kMaxObservedFrames] = lcd.getFramebuffer();
+         ++numFramesCompleted;
+      }
 
-      std::size_t firstIndex = 0;
-      for (std::size_t i = 0; i < numWorkers; ++i)
+      // Returns a description of the first observation that doesn't match a straightforward downsample of the acquired frames, or an empty string if they all do
+      std::string check() const
       {
-         std::size_t lastIndex = firstIndex + numTestsPerWorker - 1;
-         if (numLeftoverTests > 0)
+         for (std::size_t i = 0; i < sinks.size(); ++i)
          {
-            ++lastIndex;
-            --numLeftoverTests;
+            if (std::optional<std::string> mismatch = checkSink(*sinks[i], reinterpret_cast<const uint8_t*>(buffers[i].data())))
+            {
+               return *mismatch;
+            }
          }
 
-         futures.push_back(std::async(std::launch::async, runTestCartRange, TestWorkerData(testResults, messageQueue, firstIndex, lastIndex, time)));
+         return {};
+      }
 
-         firstIndex = lastIndex + 1;
+   private:
+      std::optional<std::string> checkSink(const DotMatrix::ObservationSink& sink, const uint8_t* observation) const
+      {
+         const DotMatrix::ObservationConfig& config = sink.getConfig();
+         std::size_t numFrames = config.numStackedFrames;
+         bool isFloat = config.format == DotMatrix::ObservationFormat::Float32;
+
+         for (std::size_t frame = 0; frame < numFrames; ++frame)
+         {
+            // Frames that haven't happened yet are left cleared
+            std::size_t age = config.layout == DotMatrix::ObservationLayout::Shifted ? numFrames - 1 - frame : (sink.getNewestFrameIndex() + numFrames - frame) % numFrames;
+            const DotMatrix::Framebuffer* framebuffer = age < numFramesCompleted ? &history[(numFramesCompleted - 1 - age) % kMaxObservedFrames] : nullptr;
+
+            const uint8_t* frameObservation = observation + frame * sink.getFrameSize();
+            for (std::size_t y = 0; y < sink.getHeight(); ++y)
+            {
+               for (std::size_t x = 0; x < sink.getWidth(); ++x)
+               {
+                  std::size_t index = y * sink.getWidth() + x;
+                  float actual = isFloat ? reinterpret_cast<const float*>(frameObservation)[index] : frameObservation[index] / 255.0f;
+                  float expected = framebuffer ? averageBrightness(*framebuffer, config, x, y) : 0.0f;
+
+                  // 8-bit values are rounded to the nearest step
+                  float tolerance = isFloat ? 1.0e-6f : 0.5f / 255.0f + 1.0e-6f;
+                  if (std::abs(actual - expected) > tolerance)
+                  {
+                     std::stringstream ss;
+                     ss << "factor " << +config.downsampleFactor << (isFloat ? " float" : " uint8") << (config.layout == DotMatrix::ObservationLayout::Ring ? " ring" : " shifted")
+                        << " crop " << +config.cropX << ',' << +config.cropY << ' ' << +config.cropWidth << 'x' << +config.cropHeight
+                        << ": frame " << frame << " (" << x << ", " << y << ") is " << actual << ", expected " << expected;
+                     return ss.str();
+                  }
+               }
+            }
+         }
+
+         return std::nullopt;
       }
 
-      auto allWorkersDone = [&futures]()
+      static float averageBrightness(const DotMatrix::Framebuffer& framebuffer, const DotMatrix::ObservationConfig& config, std::size_t x, std::size_t y)
       {
-         for (const std::future<void>& future : futures)
+         std::size_t factor = config.downsampleFactor;
+
+         uint32_t sum = 0;
+         for (std::size_t row = 0; row < factor; ++row)
          {
-            if (future.wait_for(std::chrono::milliseconds(0)) != std::future_status::ready)
+            for (std::size_t col = 0; col < factor; ++col)
             {
-               return false;
+               std::size_t screenX = config.cropX + x * factor + col;
+               std::size_t screenY = config.cropY + y * factor + row;
+               sum += framebuffer[screenY * DotMatrix::kScreenWidth + screenX];
             }
          }
 
-         return true;
-      };
+         // Shade 0 is white and 3 is black
+         return 1.0f - sum / (3.0f * factor * factor);
+      }
 
-      auto processMessages = [&messageQueue]()
+      DotMatrix::LCDController& lcd;
+      std::vector<std::unique_ptr<DotMatrix::ObservationSink>> sinks;
+      std::vector<std::vector<float>> buffers; // Floats so they're aligned for either format
+      std::array<DotMatrix::Framebuffer, kMaxObservedFrames> history = {};
+      std::size_t numFramesCompleted = 0;
+   };
+
+   // Every downsample factor, format and layout over the whole screen, plus a couple of crops
+   std::vector<DotMatrix::ObservationConfig> getObservationTestConfigs()
+   {
+      std::vector<DotMatrix::ObservationConfig> configs;
+
+      for (uint8_t factor : { 1, 2, 4 })
       {
-         std::string message;
-         while (messageQueue.try_dequeue(message))
+         for (DotMatrix::ObservationFormat format : { DotMatrix::ObservationFormat::UInt8, DotMatrix::ObservationFormat::Float32 })
          {
-            std::printf("%s\n", message.c_str());
+            for (DotMatrix::ObservationLayout layout : { DotMatrix::ObservationLayout::Shifted, DotMatrix::ObservationLayout::Ring })
+            {
+               DotMatrix::ObservationConfig config;
+               config.downsampleFactor = factor;
+               config.numStackedFrames = kMaxObservedFrames;
+               config.layout = layout;
+               config.format = format;
+               configs.push_back(config);
+            }
          }
-      };
+      }
 
-      bool done = false;
-      while (!done)
+      DotMatrix::ObservationConfig cropped;
+      cropped.cropX = 8;
+      cropped.cropY = 16;
+      cropped.cropWidth = 144;
+      cropped.cropHeight = 96;
+      cropped.downsampleFactor = 4;
+      cropped.numStackedFrames = 3;
+      cropped.layout = DotMatrix::ObservationLayout::Ring;
+      configs.push_back(cropped);
+
+      cropped.downsampleFactor = 2;
+      cropped.numStackedFrames = 1;
+      cropped.layout = DotMatrix::ObservationLayout::Shifted;
+      cropped.format = DotMatrix::ObservationFormat::Float32;
+      configs.push_back(cropped);
+
+      return configs;
+   }
+
+   // Configs that would index out of bounds (or silently drop lines) must not produce a sink
+   bool checkInvalidObservationConfigsRejected()
+   {
+      DotMatrix::ObservationConfig noFrames;
+      noFrames.numStackedFrames = 0;
+
+      DotMatrix::ObservationConfig unsupportedFactor;
+      unsupportedFactor.cropWidth = 159;
+      unsupportedFactor.cropHeight = 144;
+      unsupportedFactor.downsampleFactor = 3;
+
+      DotMatrix::ObservationConfig offScreen;
+      offScreen.cropX = 8;
+
+      bool allRejected = true;
+      for (const DotMatrix::ObservationConfig& config : { noFrames, unsupportedFactor, offScreen })
       {
-         done = allWorkersDone();
-         processMessages();
+         std::string error;
+         if (DotMatrix::ObservationSink::create(config, error) || error.empty())
+         {
+            allRejected = false;
+         }
+      }
 
-         if (!done)
+      if (!allRejected)
+      {
+         std::printf("Invalid observation config accepted\n");
+      }
+
+      return allRejected;
+   }
+
+   // Runs each cart with observation sinks attached, and checks the final observations against the frames the LCD controller produced
+   bool runObservationCartsInPath(std::filesystem::path path, uint32_t numFrames, bool isBlargg)
+   {
+      if (!checkInvalidObservationConfigsRejected())
+      {
+         return false;
+      }
+
+      std::vector<std::filesystem::path> filePaths = getCartPathsRecursive(path, isBlargg);
+      std::size_t numCarts = filePaths.size();
+
+      if (numCarts == 0)
+      {
+         std::printf("No carts found\n");
+         return false;
+      }
+
+      std::vector<DotMatrix::ObservationConfig> configs = getObservationTestConfigs();
+      std::vector<bool> matches(numCarts, false);
+
+      runOnWorkers(numCarts, [&filePaths, &configs, &matches, numFrames](std::size_t index)
+      {
+         std::string message = filePaths[index].generic_string() + ": ";
+
+         std::string error;
+         if (std::unique_ptr<DotMatrix::Cartridge> cartridge = loadCart(filePaths[index], error))
          {
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            std::unique_ptr<DotMatrix::GameBoy> gameBoy = std::make_unique<DotMatrix::GameBoy>();
+            gameBoy->getSoundController().setAudioPolicy(DotMatrix::AudioPolicy::Silent);
+            gameBoy->setCartridge(std::move(cartridge));
+
+            ObservationChecker checker(gameBoy->getLCDController(), configs);
+            gameBoy->getLCDController().setFramebufferSink(&checker);
+
+            for (uint32_t frame = 0; frame < numFrames; ++frame)
+            {
+               gameBoy->tick(kFrameTime);
+            }
+
+            gameBoy->getLCDController().setFramebufferSink(nullptr);
+
+            std::string mismatch = checker.check();
+            matches[index] = mismatch.empty();
+            message += mismatch.empty() ? "match" : "mismatch (" + mismatch + ")";
+         }
+         else
+         {
+            message += "error";
+            if (!error.empty())
+            {
+               message += " (" + error + ")";
+            }
+         }
+
+         return message;
+      });
+
+      std::size_t numMatches = std::count(matches.begin(), matches.end(), true);
+      std::printf("%zu of %zu observations match\n", numMatches, numCarts);
+      return numMatches == numCarts;
+   }
+
+   // Records the cart's audio (and optionally each channel's) to .wav files, e.g. to compare against a previous recording
+   bool recordCartAudio(const std::filesystem::path& cartPath, const std::filesystem::path& recordingPath, float time, bool withStems)
+   {
+      std::string error;
+      std::unique_ptr<DotMatrix::Cartridge> cartridge = loadCart(cartPath, error);
+      if (!cartridge)
+      {
+         std::string message = "Unable to load " + cartPath.generic_string();
+         if (!error.empty())
+         {
+            message += " (" + error + ")";
          }
+
+         std::printf("%s\n", message.c_str());
+         return false;
       }
 
-      std::stringstream ss;
-      for (const TestResult& result : testResults)
+      std::error_code errorCode;
+      std::filesystem::create_directories(recordingPath.parent_path(), errorCode);
+
       {
-         std::filesystem::path relativePath = result.cartPath.lexically_relative(path);
-         ss << '"' << relativePath.generic_string() << '"' << ',' << getResultName(result.result) << '\n';
+         AudioRecorder recorder(recordingPath, DotMatrix::SoundController::kDefaultSampleRate, withStems);
+         if (!recorder.isValid())
+         {
+            std::printf("Unable to write %s\n", recordingPath.generic_string().c_str());
+            return false;
+         }
+
+         std::unique_ptr<DotMatrix::GameBoy> gameBoy = std::make_unique<DotMatrix::GameBoy>();
+         gameBoy->getSoundController().setAudioSink(&recorder);
+         gameBoy->setCartridge(std::move(cartridge));
+
+         gameBoy->tick(time);
+
+         // Hands over the last partial audio frame
+         gameBoy->getSoundController().setAudioSink(nullptr);
       }
 
-      IOUtils::writeTextFile(resultPath, ss.str());
+      std::printf("Recorded %s -> %s\n", cartPath.generic_string().c_str(), recordingPath.generic_string().c_str());
+      return true;
    }
 
    void runProfileInPath(std::filesystem::path path, float time)
@@ -288,12 +847,24 @@ namespace
             std::unique_ptr<DotMatrix::GameBoy> gameBoy = std::make_unique<DotMatrix::GameBoy>();
             gameBoy->setCartridge(std::move(cartridge));
 
+            // Tick a frame at a time, so the distribution of frame times can be reported as well
+            uint64_t numFrames = static_cast<uint64_t>(time / kFrameTime + 0.5);
+            DotMatrix::PerformanceCounters counters;
+
             auto start = std::chrono::high_resolution_clock::now();
-            gameBoy->tick(time);
+            for (uint64_t frame = 0; frame < numFrames; ++frame)
+            {
+               DotMatrix::ScopedPerformanceTimer timer(counters, DotMatrix::PerformanceCounter::EmulationTime);
+               gameBoy->tick(kFrameTime);
+            }
             auto end = std::chrono::high_resolution_clock::now();
 
             std::chrono::duration<double> elapsedSeconds = end - start;
             std::printf("Elapsed time: %f\n", elapsedSeconds.count());
+
+            DotMatrix::PerformanceHistory history = counters.getHistory(DotMatrix::PerformanceCounter::EmulationTime);
+            DotMatrix::PerformanceSummary summary = DotMatrix::summarize(history);
+            std::printf("Frame time over the last %zu frames (ms): mean %.3f, p50 %.3f, p95 %.3f, p99 %.3f, max %.3f\n", history.count, summary.mean, summary.p50, summary.p95, summary.p99, summary.max);
          }
       }
    }
@@ -348,6 +919,88 @@ int main(int argc, char *argv[])
             return 0;
          }
       }
+      else if (type == "-screenshot")
+      {
+         static const uint32_t kDefaultScreenshotFrames = 1800;
+         uint32_t numFrames = kDefaultScreenshotFrames;
+
+         bool isBlargg = false;
+
+         std::optional<std::filesystem::path> cartsPath;
+         std::optional<std::filesystem::path> resultPath;
+         std::optional<std::filesystem::path> screenshotPath;
+         if (pathArg == "mooneye")
+         {
+            cartsPath = IOUtils::getAboluteProjectPath("Test/Roms/mooneye-gb_hwtests");
+            resultPath = IOUtils::getAboluteProjectPath("Test/Results/mooneye_screenshots.csv");
+            screenshotPath = IOUtils::getAboluteProjectPath("Test/Results/Screenshots/mooneye");
+         }
+         else if (pathArg == "blargg")
+         {
+            isBlargg = true;
+            cartsPath = IOUtils::getAboluteProjectPath("Test/Roms/blargg");
+            resultPath = IOUtils::getAboluteProjectPath("Test/Results/blargg_screenshots.csv");
+            screenshotPath = IOUtils::getAboluteProjectPath("Test/Results/Screenshots/blargg");
+         }
+         else
+         {
+            cartsPath = pathArg;
+            resultPath = IOUtils::getAboluteProjectPath("Test/Results/misc_screenshots.csv");
+            screenshotPath = IOUtils::getAboluteProjectPath("Test/Results/Screenshots/misc");
+         }
+
+         if (argc > 3)
+         {
+            std::stringstream ss(argv[3]);
+            uint32_t parsedFrames = 0;
+            if (ss >> parsedFrames)
+            {
+               numFrames = parsedFrames;
+            }
+         }
+
+         if (cartsPath && resultPath && screenshotPath)
+         {
+            return runScreenshotCartsInPath(*cartsPath, *resultPath, *screenshotPath, numFrames, isBlargg) ? 0 : 1;
+         }
+      }
+      else if (type == "-observe")
+      {
+         static const uint32_t kDefaultObservationFrames = 600;
+         uint32_t numFrames = kDefaultObservationFrames;
+
+         bool isBlargg = false;
+
+         std::optional<std::filesystem::path> cartsPath;
+         if (pathArg == "mooneye")
+         {
+            cartsPath = IOUtils::getAboluteProjectPath("Test/Roms/mooneye-gb_hwtests");
+         }
+         else if (pathArg == "blargg")
+         {
+            isBlargg = true;
+            cartsPath = IOUtils::getAboluteProjectPath("Test/Roms/blargg");
+         }
+         else
+         {
+            cartsPath = pathArg;
+         }
+
+         if (argc > 3)
+         {
+            std::stringstream ss(argv[3]);
+            uint32_t parsedFrames = 0;
+            if (ss >> parsedFrames)
+            {
+               numFrames = parsedFrames;
+            }
+         }
+
+         if (cartsPath)
+         {
+            return runObservationCartsInPath(*cartsPath, numFrames, isBlargg) ? 0 : 1;
+         }
+      }
       else if (type == "-profile")
       {
          static const float kDefaultProfileTime = 1'000.0f;
@@ -366,8 +1019,34 @@ int main(int argc, char *argv[])
          runProfileInPath(pathArg, time);
          return 0;
       }
+      else if (type == "-record")
+      {
+         static const float kDefaultRecordTime = 10.0f;
+         float time = kDefaultRecordTime;
+
+         if (argc > 3)
+         {
+            std::stringstream ss(argv[3]);
+            float parsedTime = 0.0f;
+            if (ss >> parsedTime)
+            {
+               time = parsedTime;
+            }
+         }
+
+         bool withStems = argc > 4 && std::string(argv[4]) == "stems";
+
+         std::filesystem::path cartPath = pathArg;
+         if (std::optional<std::filesystem::path> recordingPath = IOUtils::getAboluteProjectPath("Test/Results/Recordings"))
+         {
+            *recordingPath /= cartPath.filename();
+            recordingPath->replace_extension(".wav");
+
+            return recordCartAudio(cartPath, *recordingPath, time, withStems) ? 0 : 1;
+         }
+      }
    }
 
-   std::printf("Usage: %s {-test {suite_name|tests_dir} [test_time] | -profile cart_path [profile_time]}\n", argv[0]);
+   std::printf("Usage: %s {-test {suite_name|tests_dir} [test_time] | -screenshot {suite_name|carts_dir} [num_frames] | -observe {suite_name|carts_dir} [num_frames] | -profile cart_path [profile_time] | -record cart_path [record_time] [stems]}\n", argv[0]);
    return 0;
 }
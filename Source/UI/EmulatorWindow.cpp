@@ -7,13 +7,15 @@
 
 #include <imgui.h>
 
+#include <algorithm>
+
 namespace DotMatrix
 {
 
 void UI::renderEmulatorWindow(Emulator& emulator) const
 {
    ImGui::SetNextWindowPos(ImVec2(580.0f, 559.0f), ImGuiCond_FirstUseEver);
-   ImGui::SetNextWindowSize(ImVec2(290.0f, 90.0f), ImGuiCond_FirstUseEver);
+   ImGui::SetNextWindowSize(ImVec2(290.0f, 216.0f), ImGuiCond_FirstUseEver);
    ImGui::Begin("Emulator");
 
    float timeScale = static_cast<float>(emulator.timeScale);
@@ -23,9 +25,33 @@ void UI::renderEmulatorWindow(Emulator& emulator) const
    uint64_t clockSpeed = Math::round<uint64_t>(CPU::kClockSpeed * timeScale);
    ImGui::Text("Clock speed:  %llu", clockSpeed);
 
+   bool fastForward = emulator.fastForward.load();
+   ImGui::Checkbox("Fast forward (Tab)", &fastForward);
+   emulator.fastForward.store(fastForward);
+
+   ImGui::Text("Speed:        %.0f%%", emulator.emulationSpeed.load() * 100.0);
+
    uint64_t totalCycles = emulator.gameBoy ? emulator.gameBoy->totalCycles : 0;
    ImGui::Text("Total cycles: %llu", totalCycles);
 
+   ImGui::Checkbox("Grayscale palette", &emulator.useGrayscalePalette);
+
+#if DM_WITH_AUDIO
+   // Changing either of these reopens the audio device, so they only apply once entered (instead of on every drag step)
+   static const uint32_t kBuffersStep = 1;
+   static const uint32_t kBufferSizeStep = 64;
+   AudioManager::Config audioConfig = emulator.audioConfig.load();
+   bool audioConfigChanged = ImGui::InputScalar("Audio buffers", ImGuiDataType_U32, &audioConfig.numBuffers, &kBuffersStep, nullptr, "%u", ImGuiInputTextFlags_EnterReturnsTrue);
+   audioConfigChanged |= ImGui::InputScalar("Buffer size", ImGuiDataType_U32, &audioConfig.bufferSize, &kBufferSizeStep, nullptr, "%u", ImGuiInputTextFlags_EnterReturnsTrue);
+   if (audioConfigChanged)
+   {
+      audioConfig.numBuffers = std::clamp(audioConfig.numBuffers, AudioManager::Config::kMinBuffers, AudioManager::Config::kMaxBuffers);
+      audioConfig.bufferSize = std::clamp(audioConfig.bufferSize, AudioManager::Config::kMinBufferSize, AudioManager::Config::kMaxBufferSize);
+      emulator.audioConfig.store(audioConfig);
+      emulator.audioThreadConditionVariable.notify_all();
+   }
+#endif // DM_WITH_AUDIO
+
    ImGui::End();
 }
 
@@ -0,0 +1,67 @@
+#include "UI/UI.h"
+
+#include "UI/BeforeCoreIncludes.inl"
+#  include "Core/PerformanceCounters.h"
+#  include "Emulator/Emulator.h"
+#  include "Platform/Video/Renderer.h"
+#include "UI/AfterCoreIncludes.inl"
+
+#include <imgui.h>
+
+#include <cfloat>
+#include <cstdio>
+
+namespace DotMatrix
+{
+
+namespace
+{
+   void renderCounter(const PerformanceCounters& counters, PerformanceCounter counter, const char* units)
+   {
+      PerformanceHistory history = counters.getHistory(counter);
+      PerformanceSummary summary = summarize(history);
+
+      char overlay[128];
+      std::snprintf(overlay, sizeof(overlay), "p50 %.2f  p95 %.2f  p99 %.2f  max %.2f %s", summary.p50, summary.p95, summary.p99, summary.max, units);
+
+      ImGui::Text("%s", getPerformanceCounterName(counter));
+      ImGui::PushID(static_cast<int>(Enum::cast(counter)));
+      ImGui::PlotLines("", history.samples.data(), static_cast<int>(history.count), static_cast<int>(history.offset), overlay, FLT_MAX, FLT_MAX, ImVec2(-1.0f, 40.0f));
+      ImGui::PopID();
+   }
+}
+
+void UI::renderPerformanceWindow(const Emulator& emulator) const
+{
+   ImGui::SetNextWindowPos(ImVec2(875.0f, 190.0f), ImGuiCond_FirstUseEver);
+   ImGui::SetNextWindowSize(ImVec2(429.0f, 650.0f), ImGuiCond_FirstUseEver);
+   ImGui::SetNextWindowCollapsed(true, ImGuiCond_FirstUseEver);
+   ImGui::Begin("Performance");
+
+   ImGui::Text("Speed:       %.0f%%", emulator.emulationSpeed.load() * 100.0);
+
+   if (emulator.renderer)
+   {
+      const Renderer::UploadStats& uploadStats = emulator.renderer->getUploadStats();
+      ImGui::Text("Last upload: %zu bytes, %.1f us", uploadStats.uploadedBytes, uploadStats.uploadTime * 1000000.0);
+   }
+
+#if DM_WITH_AUDIO
+   ImGui::Text("Audio underruns: %u", emulator.audioUnderruns.load());
+#endif // DM_WITH_AUDIO
+
+   const PerformanceCounters& counters = emulator.getPerformanceCounters();
+   renderCounter(counters, PerformanceCounter::EmulationTime, "ms");
+   renderCounter(counters, PerformanceCounter::RenderTime, "ms");
+   renderCounter(counters, PerformanceCounter::SwapTime, "ms");
+   renderCounter(counters, PerformanceCounter::AudioQueuedSamples, "samples");
+   renderCounter(counters, PerformanceCounter::AudioBufferFill, "ms");
+   renderCounter(counters, PerformanceCounter::AudioRateAdjustment, "%");
+   renderCounter(counters, PerformanceCounter::AudioLatency, "ms");
+   renderCounter(counters, PerformanceCounter::AudioWakeupJitter, "ms");
+   renderCounter(counters, PerformanceCounter::Drift, "ms");
+
+   ImGui::End();
+}
+
+} // namespace DotMatrix
@@ -7,59 +7,64 @@
 
 #include <imgui.h>
 
+#include <algorithm>
 #include <cmath>
 #include <limits>
 #include <sstream>
 #include <string>
+#include <utility>
 
 namespace DotMatrix
 {
 
 namespace
 {
-   const int kNumPlottedSamples = SoundController::kSampleRate / 4;
-
-   enum class ChannelType
+   // Draws the range of a signal covered by each pixel column, from the sound controller's telemetry (oldest column first)
+   template<typename GetRange>
+   void plotRanges(const char* label, GetRange getRange, float scaleMin, float scaleMax, float height)
    {
-      Square1,
-      Square2,
-      Wave,
-      Noise
-   };
+      ImVec2 size(ImGui::GetContentRegionAvail().x - 50.0f, height);
+      ImVec2 position = ImGui::GetCursorScreenPos();
+      ImGui::Dummy(size);
 
-   float audioSampleGetter(void* data, int index)
-   {
-      std::vector<float>* floatSamples = reinterpret_cast<std::vector<float>*>(data);
+      ImDrawList* drawList = ImGui::GetWindowDrawList();
+      drawList->AddRectFilled(position, ImVec2(position.x + size.x, position.y + size.y), ImGui::GetColorU32(ImGuiCol_FrameBg), ImGui::GetStyle().FrameRounding);
 
-      return (*floatSamples)[index];
-   }
+      auto toY = [position, size, scaleMin, scaleMax](float value)
+      {
+         float fraction = std::clamp((scaleMax - value) / (scaleMax - scaleMin), 0.0f, 1.0f);
+         return position.y + fraction * (size.y - 1.0f);
+      };
 
-   void updateSamples(std::vector<float>& samples, int& offset, std::span<const SoundController::UIData> uiDataSpan, ChannelType channelType)
-   {
-      for (const SoundController::UIData& uiData : uiDataSpan)
+      ImU32 color = ImGui::GetColorU32(ImGuiCol_PlotLines);
+      std::size_t numPixels = static_cast<std::size_t>(std::max(size.x, 1.0f));
+      const std::size_t kNumColumns = SoundController::kNumUIColumns;
+      for (std::size_t pixel = 0; pixel < numPixels; ++pixel)
       {
-         int8_t sample = 0;
-         switch (channelType)
+         // Merge every column that lands in this pixel (or stretch a column across several pixels)
+         std::size_t firstColumn = pixel * kNumColumns / numPixels;
+         std::size_t lastColumn = std::max(firstColumn + 1, (pixel + 1) * kNumColumns / numPixels);
+
+         float min = std::numeric_limits<float>::max();
+         float max = std::numeric_limits<float>::lowest();
+         for (std::size_t column = firstColumn; column < lastColumn; ++column)
          {
-         case ChannelType::Square1:
-            sample = uiData.square1;
-            break;
-         case ChannelType::Square2:
-            sample = uiData.square2;
-            break;
-         case ChannelType::Wave:
-            sample = uiData.wave;
-            break;
-         case ChannelType::Noise:
-            sample = uiData.noise;
-            break;
-         default:
-            break;
+            std::pair<float, float> range = getRange(column);
+            min = std::min(min, range.first);
+            max = std::max(max, range.second);
          }
 
-         samples[offset] = static_cast<float>(sample);
-         offset = (offset + 1) % kNumPlottedSamples;
+         float x = position.x + pixel + 0.5f;
+         drawList->AddLine(ImVec2(x, toY(max)), ImVec2(x, toY(min) + 1.0f), color);
       }
+
+      ImGui::SameLine(0.0f, ImGui::GetStyle().ItemInnerSpacing.x);
+      ImGui::TextUnformatted(label);
+   }
+
+   const SoundController::UIColumn& getUIColumn(const SoundController& soundController, std::size_t index)
+   {
+      return soundController.uiColumns[(soundController.uiColumnIndex + 1 + index) % SoundController::kNumUIColumns];
    }
 
    std::string getPitch(uint32_t timerPeriod)
@@ -90,9 +95,8 @@ void UI::renderSoundControllerWindow(SoundController& soundController) const
    ImGui::SetNextWindowSize(ImVec2(570.0f, 451.0f), ImGuiCond_FirstUseEver);
    ImGui::Begin("Sound Controller");
 
-   static std::vector<SoundController::UIData> uiDataVector(SoundController::kBufferSize);
-   std::size_t numValues = soundController.consumeUIData(uiDataVector);
-   std::span<SoundController::UIData> uiDataSpan(uiDataVector.data(), numValues);
+   // Telemetry is only gathered while something plots it
+   bool plotsVisible = false;
 
    if (ImGui::CollapsingHeader("Output", ImGuiTreeNodeFlags_DefaultOpen))
    {
@@ -103,21 +107,18 @@ void UI::renderSoundControllerWindow(SoundController& soundController) const
          soundController.write(0xFF26, powerEnabled ? 0x80 : 0x00);
       }
 
-      static std::vector<float> leftSamples(kNumPlottedSamples);
-      static std::vector<float> rightSamples(kNumPlottedSamples);
-      static int offset = 0;
-
-      for (const SoundController::UIData& uiData : uiDataSpan)
+      plotRanges("Left", [&soundController](std::size_t index)
       {
-         leftSamples[offset] = static_cast<float>(uiData.sample.left);
-         rightSamples[offset] = static_cast<float>(uiData.sample.right);
-         offset = (offset + 1) % kNumPlottedSamples;
-      }
+         const SoundController::UIColumn& column = getUIColumn(soundController, index);
+         return std::pair<float, float>(column.min.left, column.max.left);
+      }, std::numeric_limits<int16_t>::min(), std::numeric_limits<int16_t>::max(), 100.0f);
+      plotRanges("Right", [&soundController](std::size_t index)
+      {
+         const SoundController::UIColumn& column = getUIColumn(soundController, index);
+         return std::pair<float, float>(column.min.right, column.max.right);
+      }, std::numeric_limits<int16_t>::min(), std::numeric_limits<int16_t>::max(), 100.0f);
 
-      ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x - 50.0f);
-      ImGui::PlotLines("Left", audioSampleGetter, &leftSamples, kNumPlottedSamples, offset, nullptr, std::numeric_limits<int16_t>::min(), std::numeric_limits<int16_t>::max(), ImVec2(0.0f, 100.0f));
-      ImGui::PlotLines("Right", audioSampleGetter, &rightSamples, kNumPlottedSamples, offset, nullptr, std::numeric_limits<int16_t>::min(), std::numeric_limits<int16_t>::max(), ImVec2(0.0f, 100.0f));
-      ImGui::PopItemWidth();
+      plotsVisible = true;
    }
 
    if (ImGui::CollapsingHeader("Mixer"))
@@ -155,12 +156,7 @@ void UI::renderSoundControllerWindow(SoundController& soundController) const
 
       SquareWaveChannel& squareWaveChannel1 = soundController.squareWaveChannel1;
 
-      static std::vector<float> samples(kNumPlottedSamples);
-      static int offset = 0;
-
-      updateSamples(samples, offset, uiDataSpan, ChannelType::Square1);
-
-      renderSoundChannel(squareWaveChannel1, samples, offset);
+      plotsVisible |= renderSoundChannel(squareWaveChannel1, soundController, 0);
       renderSoundTimer(squareWaveChannel1.timer, kWaveMaxPeriod, true);
       renderDutyUnit(squareWaveChannel1.dutyUnit);
       renderLengthUnit(squareWaveChannel1.lengthUnit);
@@ -176,12 +172,7 @@ void UI::renderSoundControllerWindow(SoundController& soundController) const
 
       SquareWaveChannel& squareWaveChannel2 = soundController.squareWaveChannel2;
 
-      static std::vector<float> samples(kNumPlottedSamples);
-      static int offset = 0;
-
-      updateSamples(samples, offset, uiDataSpan, ChannelType::Square2);
-
-      renderSoundChannel(squareWaveChannel2, samples, offset);
+      plotsVisible |= renderSoundChannel(squareWaveChannel2, soundController, 1);
       renderSoundTimer(squareWaveChannel2.timer, kWaveMaxPeriod, true);
       renderDutyUnit(squareWaveChannel2.dutyUnit);
       renderLengthUnit(squareWaveChannel2.lengthUnit);
@@ -196,12 +187,7 @@ void UI::renderSoundControllerWindow(SoundController& soundController) const
 
       WaveChannel& waveChannel = soundController.waveChannel;
 
-      static std::vector<float> samples(kNumPlottedSamples);
-      static int offset = 0;
-
-      updateSamples(samples, offset, uiDataSpan, ChannelType::Wave);
-
-      renderSoundChannel(waveChannel, samples, offset);
+      plotsVisible |= renderSoundChannel(waveChannel, soundController, 2);
       renderSoundTimer(waveChannel.timer, kWaveMaxPeriod, true);
       renderLengthUnit(waveChannel.lengthUnit);
       renderWaveUnit(waveChannel.waveUnit);
@@ -217,12 +203,7 @@ void UI::renderSoundControllerWindow(SoundController& soundController) const
 
       NoiseChannel& noiseChannel = soundController.noiseChannel;
 
-      static std::vector<float> samples(kNumPlottedSamples);
-      static int offset = 0;
-
-      updateSamples(samples, offset, uiDataSpan, ChannelType::Noise);
-
-      renderSoundChannel(noiseChannel, samples, offset);
+      plotsVisible |= renderSoundChannel(noiseChannel, soundController, 3);
       renderSoundTimer(noiseChannel.timer, kMaxNoisePeriod, false);
       renderLengthUnit(noiseChannel.lengthUnit);
       renderEnvelopeUnit(noiseChannel.envelopeUnit);
@@ -232,19 +213,29 @@ void UI::renderSoundControllerWindow(SoundController& soundController) const
    }
 
    ImGui::End();
+
+   soundController.setUITelemetryEnabled(plotsVisible);
 }
 
-void UI::renderSoundChannel(SoundChannel& soundChannel, std::vector<float>& samples, int offset) const
+bool UI::renderSoundChannel(SoundChannel& soundChannel, const SoundController& soundController, std::size_t channelIndex) const
 {
+   bool plotted = false;
+
    if (ImGui::TreeNode("Channel"))
    {
       ImGui::Checkbox("Enabled", &soundChannel.enabled);
 
-      ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x - 50.0f);
-      ImGui::PlotLines("Output", audioSampleGetter, &samples, kNumPlottedSamples, offset, nullptr, -15.0f, 15.0f, ImVec2(0.0f, 100.0f));
+      plotRanges("Output", [&soundController, channelIndex](std::size_t index)
+      {
+         const SoundController::UIColumn& column = getUIColumn(soundController, index);
+         return std::pair<float, float>(column.channelMin[channelIndex], column.channelMax[channelIndex]);
+      }, -15.0f, 15.0f, 100.0f);
+      plotted = true;
 
       ImGui::TreePop();
    }
+
+   return plotted;
 }
 
 template<typename T>
@@ -54,6 +54,7 @@ void UI::render(Emulator& emulator)
 
    renderScreenWindow(*emulator.renderer);
    renderEmulatorWindow(emulator);
+   renderPerformanceWindow(emulator);
    renderTimerWindow(*emulator.gameBoy);
    renderJoypadWindow(emulator.gameBoy->joypad);
    renderCPUWindow(emulator.gameBoy->cpu);
@@ -4,6 +4,7 @@
 #  error "Including UI header, but DM_WITH_UI is not set!"
 #endif // !DM_WITH_UI
 
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 
@@ -48,6 +49,7 @@ private:
 
    void renderScreenWindow(const Renderer& renderer) const;
    void renderEmulatorWindow(Emulator& emulator) const;
+   void renderPerformanceWindow(const Emulator& emulator) const;
    void renderTimerWindow(GameBoy& gameBoy) const;
    void renderJoypadWindow(Joypad& joypad) const;
    void renderCPUWindow(CPU& cpu) const;
@@ -59,7 +61,7 @@ private:
    void renderDebuggerWindow(GameBoy& gameBoy) const;
 #endif // DM_WITH_DEBUGGER
 
-   void renderSoundChannel(SoundChannel& soundChannel, std::vector<float>& samples, int offset) const;
+   bool renderSoundChannel(SoundChannel& soundChannel, const SoundController& soundController, std::size_t channelIndex) const;
    template<typename T>
    void renderSoundTimer(SoundTimer<T>& soundTimer, uint32_t maxPeriod, bool displayNote) const;
    void renderDutyUnit(DutyUnit& dutyUnit) const;